@@ -3,16 +3,50 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/shm.h>
 #include "ipc/shm_utils.h"
 #include "ipc/sem_utils.h"
 #include "ipc/msg_utils.h"
+#include "hash/sha256_utils.h"
+#include "hash/cdc_utils.h"
+#include "ipc/shard_utils.h"
+#include "trace/trace_utils.h"
 
-#define SHM_KEY 0x1234      // chiave per memoria condivisa
-#define MSG_KEY 0x5678      // chiave per coda messaggi
-#define SEM_KEY 0x9ABC      // chiave per semafori
 #define MAX_FILE_SIZE 65536 // max dimensione file (64 KB)
 #define CLIENT_TYPE 1       // tipo messaggio client->server
+#define MANIFEST_LINE 4352  // riga di un manifest sha256sum: digest, separatore e percorso
+
+// Percorso veloce: i file sotto la soglia vengono hashati nel processo, senza IPC
+#define FAST_PATH_MAX (1024 * 1024)     // oltre questa dimensione si delega sempre al server
+#define FAST_PATH_DEFAULT MAX_FILE_SIZE // soglia se il server non risponde alla calibrazione
+#define CALIB_ROUNDS 4                  // ripetizioni di ogni misura (si tiene la migliore)
+#define OFFLOAD_ROUND_TRIPS 2           // round trip con il loop in un upload: chunk + ack, risposta
+#define CALIB_CACHE "/tmp/sha256_soglia_%d"    // soglia calibrata, per namespace
+#define CALIB_CACHE_TTL 600             // validità della soglia in cache (secondi)
+
+// Opzioni da riga di comando, comuni a tutti i file elaborati
+int dedup = 0;              // chunking content-defined con deduplicazione lato server
+int zerocopy = 0;           // hashing in place dal segmento multi-slot
+int ns;                     // namespace delle chiavi IPC
+const char *routing = "file";
+int quiet = 0;              // verifica batch: si stampano solo i fallimenti e il riepilogo
+int batch = 0;              // verifica batch: il server risponde solo ai file falliti
+unsigned int batch_inviati[MAX_SHARDS];    // file della verifica batch delegati a ciascuno shard
+long soglia_locale = -1;    // byte sotto cui si hasha nel processo; -1 = da calibrare
+unsigned int req_seq = 0;   // richiesta corrente (un file inviato al server = una richiesta)
+
+// Segmento condiviso del client: creato al primo file delegato al server e riusato per i successivi
+key_t my_shm_key;
+int shmid = -1;
+void *shmaddr = NULL;
+
+// Messaggi di avanzamento, soppressi in modalità silenziosa
+#define INFO(...) do { if (!quiet) { printf(__VA_ARGS__); fflush(stdout); } } while (0)
 
 // ===================== FUNZIONI DI UTILITÀ =====================
 
@@ -24,83 +58,70 @@ void cleanup_and_exit(char *chunkbuf, void *shmaddr, FILE *fp, int code) {
     exit(code);
 }
 
+// Sceglie lo shard del namespace a cui inviare il file.
+// "file" e "pid": hashing consistente sulla chiave; "load": shard meno carico dalla tabella condivisa
+int scegli_shard(int ns, const char *routing, const char *path) {
+    struct load_table *table = attach_load_table(ns);
+    if (!table) return 0;   // nessuna tabella: server a shard singolo o non avviato
+
+    int shard;
+
+    // Gli shard terminati sono esclusi: le loro code e i loro semafori non esistono più
+    if (strcmp(routing, "load") == 0) {
+        shard = least_loaded_shard(table);
+    } else if (strcmp(routing, "pid") == 0) {
+        char key[32];
+        snprintf(key, sizeof(key), "%d", getpid());
+        shard = shard_for_key(table, key);
+    } else {
+        shard = shard_for_key(table, path);
+    }
+    if (shard < 0) shard = 0;
+
+    detach_shared_memory(table);
+    return shard;
+}
+
+// Funzione di utilità: invia un messaggio al server e attende l'ack, rispettando il backpressure
+int scambia_con_server(int msgid, struct message *msg, struct message *ack) {
+    TRACE(client_chunk_send, msg->pid, msg->seq, msg->chunk_id);
+    if (send_message(msgid, msg) == -1) return -1;
+    if (receive_message(msgid, msg->pid, ack) == -1) return -1;
+    TRACE(client_ack_recv, msg->pid, msg->seq, msg->chunk_id);
+
+    // Backpressure: il server chiede di rallentare prima del prossimo chunk
+    if (ack->backoff_ms > 0) {
+        usleep(ack->backoff_ms * 1000);
+    }
+    return 0;
+}
+
 // Funzione di utilità: invia un chunk al server e attende ack
 int invia_chunk_al_server(int semid, void *shmaddr, char *chunkbuf, size_t chunk_size, int msgid, struct message *msg, FILE *fp) {
+    TRACE(sem_mem_wait, msg->pid, msg->seq, msg->chunk_id);
     sem_wait(semid, 0);
+    TRACE(sem_mem_acquired, msg->pid, msg->seq, msg->chunk_id);
     memcpy(shmaddr, chunkbuf, chunk_size);
     sem_signal(semid, 0);
 
-    if (send_message(msgid, msg) == -1) {
-        cleanup_and_exit(chunkbuf, shmaddr, fp, EXIT_FAILURE);
-    }
-
     struct message ack;
-    if (receive_message(msgid, msg->pid, &ack) == -1) {
+    if (scambia_con_server(msgid, msg, &ack) == -1) {
         cleanup_and_exit(chunkbuf, shmaddr, fp, EXIT_FAILURE);
     }
     return 1;
 }
 
-int main(int argc, char *argv[]) {
-
-    // ===================== PARSING ARGOMENTI =====================
-    if (argc != 2) {
-        fprintf(stderr, "Uso: %s <file>\n", argv[0]);
-        exit(EXIT_FAILURE);
-    }
-
-    // ===================== APERTURA FILE E CALCOLO DIMENSIONE =====================
-    FILE *fp = fopen(argv[1], "rb");
-    if (!fp) {
-        perror("Errore apertura file");
-        exit(EXIT_FAILURE);
-    }
-
-    fseek(fp, 0, SEEK_END);
-    size_t filesize = ftell(fp);
-    rewind(fp);
-    printf("[CLIENT] File '%s' letto (%zu byte).\n", argv[1], filesize);
-
-    // ===================== INIZIALIZZAZIONE MEMORIA CONDIVISA E SEMAFORI =====================
-    key_t my_shm_key = SHM_KEY + getpid();
-    int shmid = create_shared_memory(my_shm_key, MAX_FILE_SIZE);
-    if (shmid == -1) {
-        fclose(fp);
-        exit(EXIT_FAILURE);
-    }
-
-    void *shmaddr = attach_shared_memory(shmid);
-    if (!shmaddr) {
-        fclose(fp);
-        exit(EXIT_FAILURE);
-    }
-
-    int semid = create_semaphore_set(SEM_KEY, 2);
-    if (semid == -1) {
-        detach_shared_memory(shmaddr);
-        fclose(fp);
-        exit(EXIT_FAILURE);
-    }
-
-    // ===================== CALCOLO CHUNK E APERTURA CODA MESSAGGI =====================
-    size_t total_chunks = (filesize + MAX_FILE_SIZE - 1) / MAX_FILE_SIZE;
-
-    int msgid = create_message_queue(MSG_KEY);
-    if (msgid == -1) {
-        detach_shared_memory(shmaddr);
-        fclose(fp);
-        exit(EXIT_FAILURE);
-    }
+// Invio classico: chunk di dimensione fissa copiati uno alla volta nella shm
+void invia_file_classico(int semid, void *shmaddr, int msgid, key_t shm_key, FILE *fp, size_t filesize) {
+    // Anche un file vuoto produce un chunk (vuoto), così il server risponde comunque
+    size_t total_chunks = filesize ? (filesize + MAX_FILE_SIZE - 1) / MAX_FILE_SIZE : 1;
 
     char *chunkbuf = malloc(MAX_FILE_SIZE);
     if (!chunkbuf) {
         perror("malloc");
-        detach_shared_memory(shmaddr);
-        fclose(fp);
-        exit(EXIT_FAILURE);
+        cleanup_and_exit(NULL, shmaddr, fp, EXIT_FAILURE);
     }
 
-    // ===================== INVIO CHUNK AL SERVER =====================
     size_t last_printed = 0;
     for (size_t i = 0; i < total_chunks; ++i) {
         size_t chunk_size = (i == total_chunks - 1) ? (filesize - i * MAX_FILE_SIZE) : MAX_FILE_SIZE;
@@ -111,41 +132,691 @@ int main(int argc, char *argv[]) {
             cleanup_and_exit(chunkbuf, shmaddr, fp, EXIT_FAILURE);
         }
         if (i != last_printed) {
-            printf("[CLIENT] Invio chunk %zu/%zu\r", i+1, total_chunks);
-            fflush(stdout);
+            INFO("[CLIENT] Invio chunk %zu/%zu\r", i+1, total_chunks);
             last_printed = i;
         }
 
         struct message msg = {
-            1,                          // tipo messaggio (1 = client->server)
+            CLIENT_TYPE,                // tipo messaggio (1 = client->server)
             getpid(),
             chunk_size,
             {0},                     // hash (non usato in invio, solo in risposta)
             i,
             total_chunks,
             (i == total_chunks - 1) ? 1 : 0, // last chunk: 1 se è l'ultimo chunk, altrimenti 0
-            my_shm_key
+            shm_key,
+            0,                          // backoff_ms (impostato dal server nell'ack)
+            OP_UPLOAD,
+            req_seq
         };
 
         invia_chunk_al_server(semid, shmaddr, chunkbuf, chunk_size, msgid, &msg, fp);
     }
-    printf("\n");
+    INFO("\n");
     free(chunkbuf);
+}
+
+// Funzione di utilità: attende l'ack del chunk zero-copy più vecchio in volo (che libera il suo slot)
+void attendi_ack_zerocopy(void *shmaddr, int msgid, FILE *fp) {
+    struct message ack;
+    if (receive_message(msgid, getpid(), &ack) == -1) {
+        cleanup_and_exit(NULL, shmaddr, fp, EXIT_FAILURE);
+    }
+    TRACE(client_ack_recv, getpid(), ack.seq, ack.chunk_id);
+
+    if (ack.op == OP_ZC_REJECT) {
+        fprintf(stderr, "[CLIENT] Upload zero-copy rifiutato dal server.\n");
+        cleanup_and_exit(NULL, shmaddr, fp, EXIT_FAILURE);
+    }
+
+    // Backpressure: il server chiede di rallentare prima del prossimo chunk
+    if (ack.backoff_ms > 0) {
+        usleep(ack.backoff_ms * 1000);
+    }
+}
+
+// Invio zero-copy: il file viene letto direttamente negli slot del segmento condiviso e il server
+// li hasha in place. Fino a ZC_SLOTS chunk sono in volo: si attende un ack solo per riusare uno slot
+void invia_file_zerocopy(void *shmaddr, int msgid, key_t shm_key, FILE *fp, size_t filesize) {
+    // Anche un file vuoto produce un chunk (vuoto), così il server risponde comunque
+    size_t total_chunks = filesize ? (filesize + ZC_SLOT_SIZE - 1) / ZC_SLOT_SIZE : 1;
+    size_t inflight = 0;
+
+    for (size_t i = 0; i < total_chunks; ++i) {
+        if (inflight == ZC_SLOTS) {
+            attendi_ack_zerocopy(shmaddr, msgid, fp);
+            inflight--;
+        }
+
+        size_t chunk_size = (i == total_chunks - 1) ? (filesize - i * ZC_SLOT_SIZE) : ZC_SLOT_SIZE;
+        char *slot = (char *)shmaddr + (i % ZC_SLOTS) * ZC_SLOT_SIZE;
+        if (fread(slot, 1, chunk_size, fp) != chunk_size) {
+            fprintf(stderr, "Errore lettura chunk %zu dal file.\n", i);
+            cleanup_and_exit(NULL, shmaddr, fp, EXIT_FAILURE);
+        }
+
+        struct message msg = {
+            CLIENT_TYPE,
+            getpid(),
+            chunk_size,
+            {0},
+            i,
+            total_chunks,
+            (i == total_chunks - 1) ? 1 : 0,
+            shm_key,
+            0,
+            OP_ZEROCOPY,
+            req_seq
+        };
+
+        TRACE(client_chunk_send, msg.pid, msg.seq, msg.chunk_id);
+        if (send_message(msgid, &msg) == -1) {
+            cleanup_and_exit(NULL, shmaddr, fp, EXIT_FAILURE);
+        }
+        inflight++;
+    }
+
+    // Attende gli ack rimasti: la risposta con l'hash arriva solo dopo l'ultimo
+    while (inflight > 0) {
+        attendi_ack_zerocopy(shmaddr, msgid, fp);
+        inflight--;
+    }
+}
+
+// Invio dei chunk mancanti di un annuncio CDC: i dati vengono impacchettati uno dopo l'altro
+// nella shm, quindi più chunk piccoli viaggiano con un solo messaggio. Ritorna i byte trasferiti
+size_t invia_chunk_mancanti(int semid, void *shmaddr, int msgid, struct message *annuncio,
+                            const struct message *ack, const struct cdc_record *records,
+                            char *const *dati, FILE *fp) {
+    unsigned int n = (unsigned int)annuncio->filesize;
+    unsigned int da_inviare = (unsigned int)ack->filesize;
+    size_t transferred = 0;
+    unsigned int i = 0;
+
+    while (da_inviare > 0) {
+        struct message msg = *annuncio;
+        msg.op = OP_CDC_DATA;
+        msg.filesize = 0;
+        msg.total_chunks = 0;
+
+        TRACE(sem_mem_wait, msg.pid, msg.seq, msg.chunk_id);
+        sem_wait(semid, 0);
+        TRACE(sem_mem_acquired, msg.pid, msg.seq, msg.chunk_id);
+        for (; i < n; ++i) {
+            if (!(ack->hash[i / 8] & (1 << (i % 8)))) continue;
+            if (msg.filesize + records[i].len > MAX_FILE_SIZE) break;
+
+            // chunk_id del pacchetto: primo chunk che contiene (distingue i pacchetti nel tracing)
+            if (msg.total_chunks == 0) msg.chunk_id = annuncio->chunk_id + i;
+
+            memcpy((char *)shmaddr + msg.filesize, dati[i], records[i].len);
+            msg.filesize += records[i].len;
+            msg.total_chunks++;
+        }
+        sem_signal(semid, 0);
+
+        da_inviare -= msg.total_chunks;
+        msg.last_chunk = annuncio->last_chunk && da_inviare == 0;
+
+        struct message data_ack;
+        if (scambia_con_server(msgid, &msg, &data_ack) == -1) {
+            cleanup_and_exit(NULL, shmaddr, fp, EXIT_FAILURE);
+        }
+        if (data_ack.op == OP_CDC_REJECT) {
+            fprintf(stderr, "[CLIENT] Chunk rifiutati dal server.\n");
+            cleanup_and_exit(NULL, shmaddr, fp, EXIT_FAILURE);
+        }
+        transferred += msg.filesize;
+    }
+    return transferred;
+}
+
+// Invio content-defined (deduplicazione): si annunciano prima i digest, a blocchi di CDC_BATCH chunk
+// scritti nella shm, e si copiano solo i chunk che il server indica come mancanti nella bitmap dell'ack.
+// Ritorna 1 se il server ha interrotto l'upload perché un chunk non corrisponde al file atteso
+int invia_file_cdc(int semid, void *shmaddr, int msgid, key_t shm_key, FILE *fp, size_t filesize) {
+    // Finestra di lettura: i dati di un intero blocco restano in memoria finché il server non
+    // ha indicato quali chunk gli mancano
+    size_t window = (size_t)CDC_BATCH * CDC_AVG_CHUNK;
+    char *buf = malloc(window);
+    if (!buf) {
+        perror("malloc");
+        cleanup_and_exit(NULL, shmaddr, fp, EXIT_FAILURE);
+    }
+
+    struct cdc_record records[CDC_BATCH];
+    char *dati[CDC_BATCH];
+    size_t avail = 0, pos = 0, read_total = 0, consumed = 0, transferred = 0;
+    unsigned int chunk_id = 0;
+
+    do {
+        // Ricarica la finestra con i dati non ancora suddivisi in chunk
+        memmove(buf, buf + pos, avail - pos);
+        avail -= pos;
+        pos = 0;
+        while (avail < window && read_total < filesize) {
+            size_t nread = fread(buf + avail, 1, window - avail, fp);
+            if (nread == 0) {
+                fprintf(stderr, "Errore lettura dal file.\n");
+                cleanup_and_exit(buf, shmaddr, fp, EXIT_FAILURE);
+            }
+            avail += nread;
+            read_total += nread;
+        }
+
+        // Un blocco termina a CDC_BATCH chunk o quando nella finestra resta meno di un chunk massimo
+        // (salvo a fine file). Anche un file vuoto produce un chunk (vuoto)
+        unsigned int n = 0;
+        do {
+            size_t len = cdc_next_boundary((unsigned char *)buf + pos, avail - pos);
+            records[n].len = (unsigned int)len;
+            compute_sha256((unsigned char *)buf + pos, len, records[n].digest);
+            dati[n] = buf + pos;
+            pos += len;
+            consumed += len;
+            n++;
+        } while (n < CDC_BATCH && consumed < filesize &&
+                 (avail - pos >= CDC_MAX_CHUNK || read_total == filesize));
+
+        struct message msg = {
+            CLIENT_TYPE,
+            getpid(),
+            n,                          // filesize: numero di record nella shm
+            {0},
+            chunk_id,
+            0,                          // total_chunks: non noto in anticipo con confini content-defined
+            (consumed == filesize) ? 1 : 0,
+            shm_key,
+            0,
+            OP_CDC_ANNOUNCE,
+            req_seq
+        };
+
+        TRACE(sem_mem_wait, msg.pid, msg.seq, msg.chunk_id);
+        sem_wait(semid, 0);
+        TRACE(sem_mem_acquired, msg.pid, msg.seq, msg.chunk_id);
+        memcpy(shmaddr, records, n * sizeof(struct cdc_record));
+        sem_signal(semid, 0);
+
+        struct message ack;
+        if (scambia_con_server(msgid, &msg, &ack) == -1) {
+            cleanup_and_exit(buf, shmaddr, fp, EXIT_FAILURE);
+        }
+
+        if (ack.op == OP_VERIFY_MISMATCH) {
+            free(buf);
+            return 1;
+        }
+
+        if (ack.op == OP_CDC_REJECT) {
+            fprintf(stderr, "[CLIENT] Chunk %u-%u rifiutati dal server.\n", chunk_id, chunk_id + n - 1);
+            cleanup_and_exit(buf, shmaddr, fp, EXIT_FAILURE);
+        }
+
+        // Il server non ha alcuni chunk: li si copia nella shm e li si invia
+        if (ack.op == OP_CDC_DATA) {
+            transferred += invia_chunk_mancanti(semid, shmaddr, msgid, &msg, &ack, records, dati, fp);
+        }
+
+        chunk_id += n;
+    } while (consumed < filesize);
+
+    INFO("[CLIENT] Deduplicazione: %u chunk, trasferiti %zu byte su %zu.\n", chunk_id, transferred, filesize);
+    free(buf);
+    return 0;
+}
+
+// Apre la verifica: il server confronterà il digest calcolato con quello atteso.
+// In una verifica batch il server risponderà solo se il file non corrisponde
+void inizia_verifica(int msgid, key_t shm_key, size_t filesize, const char *expected, FILE *fp) {
+    struct message msg = {
+        CLIENT_TYPE,
+        getpid(),
+        filesize,
+        {0},                        // hash: digest atteso
+        0,
+        batch,                      // total_chunks: 1 = verifica batch
+        0,
+        shm_key,
+        0,
+        OP_VERIFY_BEGIN,
+        req_seq
+    };
+    strncpy(msg.hash, expected, HASH_SIZE - 1);
+
+    struct message ack;
+    if (scambia_con_server(msgid, &msg, &ack) == -1) {
+        cleanup_and_exit(NULL, NULL, fp, EXIT_FAILURE);
+    }
+}
+
+// Crea (al primo uso) il segmento condiviso del client
+void prepara_segmento(FILE *fp) {
+    if (shmaddr) return;
+
+    my_shm_key = ipc_client_shm_key(ns, getpid());
+    shmid = create_shared_memory(my_shm_key, zerocopy ? ZC_SLOTS * ZC_SLOT_SIZE : MAX_FILE_SIZE);
+    shmaddr = (shmid == -1) ? NULL : attach_shared_memory(shmid);
+    if (!shmaddr) {
+        if (shmid != -1) remove_shared_memory(shmid);
+        cleanup_and_exit(NULL, NULL, fp, EXIT_FAILURE);
+    }
+}
+
+// Funzione di utilità: tempo monotono in microsecondi
+double ora_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Round trip di un ping al server (in microsecondi); -1 se non risponde entro PING_TIMEOUT_US.
+// Prima dell'invio si scartano le risposte arrivate in ritardo a ping precedenti; il ping porta
+// l'istante di invio, così il server non risponde a quelli rimasti in coda più a lungo di quanto
+// il client li attenda
+double misura_round_trip(int msgid) {
+    struct message pong;
+    while (receive_message_nowait(msgid, PING_REPLY_TYPE(getpid()), &pong) == 0);
+
+    double start = ora_us();
+    struct message ping = {
+        CLIENT_TYPE,
+        getpid(),
+        (size_t)start,              // filesize: istante di invio
+        {0},
+        0,
+        0,
+        0,
+        0,
+        0,
+        OP_PING,
+        req_seq
+    };
+    if (send_message(msgid, &ping) == -1) return -1;
+
+    // Attesa non bloccante: con il server fermo (o bloccato) si rinuncia dopo PING_TIMEOUT_US
+    while (receive_message_nowait(msgid, PING_REPLY_TYPE(getpid()), &pong) == -1) {
+        if (ora_us() - start > PING_TIMEOUT_US) return -1;
+        usleep(20);
+    }
+    return ora_us() - start;
+}
+
+// Costo di fork, uscita e raccolta di un processo: stima locale del dispatch di un worker
+double misura_fork(void) {
+    double start = ora_us();
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) return -1;
+    if (pid == 0) _exit(0);
+    waitpid(pid, NULL, 0);
+    return ora_us() - start;
+}
+
+// Costo fisso di un upload, misurato senza occupare un worker del server (che con tutti i worker
+// impegnati farebbe attendere la calibrazione dietro gli hash in corso): OFFLOAD_ROUND_TRIPS round
+// trip con il loop dello shard (chunk e ack, risposta) più il dispatch di un worker.
+// Ritorna i microsecondi stimati, -1 se lo shard non risponde
+double misura_offload(int shard) {
+    int msgid = attach_message_queue(ipc_keys_for(ns, shard).msg_key);
+    double rtt_us = -1, fork_us = -1;
+    for (int i = 0; msgid != -1 && i < CALIB_ROUNDS; ++i) {
+        double rtt = misura_round_trip(msgid);
+        if (rtt < 0) return -1;
+        if (rtt_us < 0 || rtt < rtt_us) rtt_us = rtt;
+
+        double f = misura_fork();
+        if (f >= 0 && (fork_us < 0 || f < fork_us)) fork_us = f;
+    }
+    if (rtt_us < 0 || fork_us < 0) return -1;
+    return OFFLOAD_ROUND_TRIPS * rtt_us + fork_us;
+}
+
+// Soglia calibrata in cache per il namespace, valida per CALIB_CACHE_TTL secondi e solo per
+// l'istanza del server che l'ha misurata (identificata dal segmento della tabella dei carichi).
+// Ritorna -1 se manca o non è più valida
+long leggi_soglia_in_cache(int server_id) {
+    char path[64];
+    snprintf(path, sizeof(path), CALIB_CACHE, ns);
+
+    struct stat st;
+    if (server_id == -1 || stat(path, &st) == -1 || time(NULL) - st.st_mtime > CALIB_CACHE_TTL) {
+        return -1;
+    }
+
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    int id;
+    long soglia;
+    int ok = fscanf(f, "%d %ld", &id, &soglia) == 2 && id == server_id && soglia >= 0;
+    fclose(f);
+    return ok ? soglia : -1;
+}
+
+// Salva la soglia calibrata: scrittura su file temporaneo e rename, così un client concorrente
+// legge sempre una riga completa
+void salva_soglia_in_cache(int server_id, long soglia) {
+    char path[64], tmp[80];
+    snprintf(path, sizeof(path), CALIB_CACHE, ns);
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    fprintf(f, "%d %ld\n", server_id, soglia);
+    fclose(f);
+    if (rename(tmp, path) == -1) remove(tmp);
+}
+
+// Calibra la soglia del percorso veloce: la soglia è la dimensione che si hasha nel processo nel tempo
+// del costo fisso di un upload (round trip con lo shard e dispatch di un worker). Sotto la soglia l'IPC
+// costerebbe più dell'hash stesso. La misura si fa una volta per istanza del server: poi si usa la cache
+long calibra_soglia(int shard) {
+    int server_id = shmget(ipc_load_key(ns), 0, 0);
+    long soglia = leggi_soglia_in_cache(server_id);
+    if (soglia >= 0) {
+        INFO("[CLIENT] Soglia percorso veloce %ld byte (calibrazione in cache).\n", soglia);
+        return soglia;
+    }
+
+    unsigned char *buf = malloc(MAX_FILE_SIZE);
+    if (!buf) return FAST_PATH_DEFAULT;
+    memset(buf, 0xA5, MAX_FILE_SIZE);
+
+    char hash[HASH_SIZE];
+    double hash_us = -1;
+    for (int i = 0; i < CALIB_ROUNDS; ++i) {
+        double start = ora_us();
+        compute_sha256(buf, MAX_FILE_SIZE, hash);
+        double elapsed = ora_us() - start;
+        if (hash_us < 0 || elapsed < hash_us) hash_us = elapsed;
+    }
+    free(buf);
+
+    double offload_us = misura_offload(shard);
+    if (offload_us < 0 || hash_us <= 0) {
+        INFO("[CLIENT] Calibrazione non riuscita: soglia percorso veloce %d byte.\n", FAST_PATH_DEFAULT);
+        return FAST_PATH_DEFAULT;
+    }
+
+    double bytes_per_us = MAX_FILE_SIZE / hash_us;
+    soglia = (long)(offload_us * bytes_per_us);
+    if (soglia > FAST_PATH_MAX) soglia = FAST_PATH_MAX;
+    salva_soglia_in_cache(server_id, soglia);
+
+    INFO("[CLIENT] Calibrazione: hash locale %.0f MB/s, costo fisso di un upload %.1f us, soglia percorso veloce %ld byte.\n",
+         bytes_per_us, offload_us, soglia);
+    return soglia;
+}
+
+// Percorso veloce: hash calcolato nel processo, con la stessa forma di risposta del server
+void hash_locale(FILE *fp, const char *expected, struct message *resp) {
+    memset(resp, 0, sizeof(*resp));
+
+    struct sha256_stream sha;
+    unsigned char buf[MAX_FILE_SIZE];
+    size_t n;
+    int ok = sha256_stream_init(&sha);
+    while (ok && (n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        ok = sha256_stream_update(&sha, buf, n);
+    }
+    if (!ok || ferror(fp) || !sha256_stream_final(&sha, resp->hash)) {
+        fprintf(stderr, "Errore calcolo SHA-256 locale.\n");
+        cleanup_and_exit(NULL, shmaddr, fp, EXIT_FAILURE);
+    }
+
+    if (expected) {
+        resp->op = (strcmp(resp->hash, expected) == 0) ? OP_VERIFY_OK : OP_VERIFY_MISMATCH;
+    }
+}
+
+// Elabora un file e ne restituisce il digest in `resp`: sotto la soglia lo hasha nel processo,
+// altrimenti lo invia al server. Con `expected` la risposta è OP_VERIFY_OK o OP_VERIFY_MISMATCH
+// (verifica fatta dal server per i file delegati). Ritorna -1 se il file non è leggibile,
+// 1 se il file fa parte di una verifica batch: l'esito arriverà con la chiusura del batch
+int elabora_file(const char *path, const char *expected, struct message *resp) {
+    // ===================== APERTURA FILE E CALCOLO DIMENSIONE =====================
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "%s: ", path);
+        perror("Errore apertura file");
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size_t filesize = ftell(fp);
+    rewind(fp);
+    INFO("[CLIENT] File '%s' letto (%zu byte).\n", path, filesize);
+
+    // ===================== SCELTA SHARD =====================
+    int shard = scegli_shard(ns, routing, path);
+
+    // ===================== PERCORSO VELOCE (NEL PROCESSO) =====================
+    if (soglia_locale < 0 && filesize < FAST_PATH_MAX) {
+        soglia_locale = calibra_soglia(shard);
+    }
+    if ((long)filesize < soglia_locale) {
+        INFO("[CLIENT] Hash calcolato nel processo (sotto la soglia di %ld byte).\n", soglia_locale);
+        hash_locale(fp, expected, resp);
+        fclose(fp);
+        return 0;
+    }
+    prepara_segmento(fp);
+    req_seq++;
+    key_t shm_key = my_shm_key;
+
+    // ===================== CHIAVI IPC DELLO SHARD =====================
+    struct ipc_keys keys = ipc_keys_for(ns, shard);
+    INFO("[CLIENT] Invio allo shard %d (namespace %d).\n", shard, ns);
+
+    int semid = create_semaphore_set(keys.sem_key, 2);
+    int msgid = (semid == -1) ? -1 : create_message_queue(keys.msg_key);
+    if (msgid == -1) {
+        cleanup_and_exit(NULL, shmaddr, fp, EXIT_FAILURE);
+    }
+
+    // ===================== INVIO CHUNK AL SERVER =====================
+    if (expected) {
+        inizia_verifica(msgid, shm_key, filesize, expected, fp);
+    }
+
+    int aborted = 0;
+    if (dedup) {
+        aborted = invia_file_cdc(semid, shmaddr, msgid, shm_key, fp, filesize);
+    } else if (zerocopy) {
+        invia_file_zerocopy(shmaddr, msgid, shm_key, fp, filesize);
+    } else {
+        invia_file_classico(semid, shmaddr, msgid, shm_key, fp, filesize);
+    }
     fclose(fp);
 
+    // Verifica batch: il server risponde solo ai fallimenti (anche a quelli interrotti a metà file)
+    if (batch) {
+        batch_inviati[shard]++;
+        return 1;
+    }
+
+    // Verifica interrotta dal server a metà file: non arriverà alcuna risposta con l'hash
+    if (aborted) {
+        memset(resp, 0, sizeof(*resp));
+        resp->op = OP_VERIFY_MISMATCH;
+        return 0;
+    }
+
     // ===================== ATTESA RISPOSTA SHA256 DAL SERVER =====================
-    printf("[CLIENT] In attesa di risposta dal server...\n");
+    INFO("[CLIENT] In attesa di risposta dal server...\n");
+    if (receive_message(msgid, getpid(), resp) == -1) {
+        cleanup_and_exit(NULL, shmaddr, NULL, EXIT_FAILURE);
+    }
+    TRACE(client_resp_recv, getpid(), resp->seq, 0);
+    return 0;
+}
+
+// Normalizza il digest atteso (minuscolo) e ne controlla il formato
+int prepara_digest_atteso(char *digest) {
+    for (char *c = digest; *c; ++c) {
+        *c = tolower((unsigned char)*c);
+    }
+    return sha256_hex_valid(digest);
+}
+
+// Chiude la verifica batch su uno shard: stampa i file falliti riportati dal server e ne attende
+// il riepilogo, che arriva quando tutti i file inviati allo shard hanno un esito.
+// `percorsi` associa il numero di richiesta al file. Ritorna il numero di file falliti
+int chiudi_batch(int shard, char **percorsi, unsigned int num_percorsi) {
+    int msgid = attach_message_queue(ipc_keys_for(ns, shard).msg_key);
+    struct message msg = {
+        CLIENT_TYPE,
+        getpid(),
+        batch_inviati[shard],       // filesize: file inviati allo shard
+        {0},
+        0,
+        0,
+        0,
+        0,
+        0,
+        OP_VERIFY_END,
+        req_seq
+    };
+    if (msgid == -1 || send_message(msgid, &msg) == -1) {
+        fprintf(stderr, "[CLIENT] Shard %d non raggiungibile: %u file senza esito.\n", shard, batch_inviati[shard]);
+        return (int)batch_inviati[shard];
+    }
+
     struct message resp;
+    while (receive_message(msgid, VERIFY_REPLY_TYPE(getpid()), &resp) == 0) {
+        if (resp.op == OP_VERIFY_END) {
+            return (int)resp.total_chunks;
+        }
+        printf("%s: FAILED\n", resp.seq < num_percorsi && percorsi[resp.seq] ? percorsi[resp.seq] : "?");
+    }
+    return (int)batch_inviati[shard];
+}
 
-    if (receive_message(msgid, getpid(), &resp) == -1) {
-        detach_shared_memory(shmaddr);
+// Verifica batch di un manifest in formato sha256sum ("<digest>  <file>" o "<digest> *<file>").
+// I file delegati al server vengono inviati uno dopo l'altro senza attendere l'esito: il server
+// risponde solo per quelli falliti e con un riepilogo per shard alla fine.
+// Ritorna il numero di file che non hanno superato la verifica
+int verifica_manifest(const char *manifest) {
+    FILE *mf = fopen(manifest, "r");
+    if (!mf) {
+        perror("Errore apertura manifest");
+        cleanup_and_exit(NULL, shmaddr, NULL, EXIT_FAILURE);
+    }
+
+    char line[MANIFEST_LINE];
+    int checked = 0, failed = 0;
+    char **percorsi = NULL;         // percorsi dei file delegati, indicizzati per numero di richiesta
+    unsigned int num_percorsi = 0;
+    batch = 1;
+    while (fgets(line, sizeof(line), mf)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+
+        // Separatore dopo i 64 caratteri del digest: spazio, poi spazio (testo) o '*' (binario)
+        if (strlen(line) < HASH_SIZE + 2 || line[HASH_SIZE - 1] != ' ' ||
+            (line[HASH_SIZE] != ' ' && line[HASH_SIZE] != '*')) {
+            fprintf(stderr, "%s: riga non valida ignorata: %s\n", manifest, line);
+            continue;
+        }
+        line[HASH_SIZE - 1] = '\0';
+        const char *path = line + HASH_SIZE + 1;
+        checked++;
+
+        struct message resp;
+        int esito = prepara_digest_atteso(line) ? elabora_file(path, line, &resp) : -1;
+        if (esito == 1) {
+            // Esito dal server: si conserva il percorso per stampare un eventuale fallimento
+            if (req_seq >= num_percorsi) {
+                unsigned int n = num_percorsi ? num_percorsi * 2 : 64;
+                char **p = realloc(percorsi, n * sizeof(*percorsi));
+                if (!p) {
+                    perror("realloc");
+                    cleanup_and_exit(NULL, shmaddr, mf, EXIT_FAILURE);
+                }
+                memset(p + num_percorsi, 0, (n - num_percorsi) * sizeof(*p));
+                percorsi = p;
+                num_percorsi = n;
+            }
+            percorsi[req_seq] = strdup(path);
+        } else if (esito == -1 || resp.op != OP_VERIFY_OK) {
+            printf("%s: FAILED\n", path);
+            failed++;
+        }
+    }
+    fclose(mf);
+
+    for (int shard = 0; shard < MAX_SHARDS; ++shard) {
+        if (batch_inviati[shard]) failed += chiudi_batch(shard, percorsi, num_percorsi);
+    }
+    for (unsigned int i = 0; i < num_percorsi; ++i) {
+        free(percorsi[i]);
+    }
+    free(percorsi);
+
+    printf("[CLIENT] Verifica completata: %d file, %d falliti.\n", checked, failed);
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+
+    // ===================== PARSING ARGOMENTI =====================
+    const char *usage = "Uso: %s [-d | -z] [-n namespace] [-r file|pid|load] [-t soglia] [-v digest] <file>\n"
+                        "     %s [-d | -z] [-n namespace] [-r file|pid|load] [-t soglia] -V <manifest>\n";
+    char *expected = NULL;
+    const char *manifest = NULL;
+    ns = ipc_default_namespace();
+    int opt;
+    char *end;
+    while ((opt = getopt(argc, argv, "dzn:r:t:v:V:")) != -1) {
+        if (opt == 'd') {
+            dedup = 1;
+        } else if (opt == 'z') {
+            zerocopy = 1;
+        } else if (opt == 'n' && (ns = ipc_parse_namespace(optarg)) >= 0) {
+            continue;
+        } else if (opt == 'r' && (strcmp(optarg, "file") == 0 || strcmp(optarg, "pid") == 0 ||
+                                  strcmp(optarg, "load") == 0)) {
+            routing = optarg;
+        } else if (opt == 't' && (soglia_locale = strtol(optarg, &end, 10)) >= 0 && *optarg && !*end) {
+            continue;           // soglia del percorso veloce in byte, senza calibrazione (0 = sempre al server)
+        } else if (opt == 'v' && prepara_digest_atteso(optarg)) {
+            expected = optarg;  // verifica: il server confronta il digest calcolato con questo
+        } else if (opt == 'V') {
+            manifest = optarg;  // verifica batch di un manifest in formato sha256sum
+        } else {
+            fprintf(stderr, usage, argv[0], argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc - (manifest ? 0 : 1) || (dedup && zerocopy) || (manifest && expected)) {
+        fprintf(stderr, usage, argv[0], argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    printf("[CLIENT] SHA-256 ricevuto: %s\n", resp.hash);
+    int code = EXIT_SUCCESS;
+    if (manifest) {
+        quiet = 1;
+        if (verifica_manifest(manifest) > 0) code = EXIT_FAILURE;
+    } else {
+        const char *path = argv[optind];
+        struct message resp;
+        if (elabora_file(path, expected, &resp) == -1) {
+            code = EXIT_FAILURE;
+        } else if (!expected) {
+            printf("[CLIENT] SHA-256 ricevuto: %s\n", resp.hash);
+        } else if (resp.op == OP_VERIFY_OK) {
+            printf("[CLIENT] Verifica %s: OK\n", path);
+        } else {
+            printf("[CLIENT] Verifica %s: FAILED\n", path);
+            if (resp.hash[0]) printf("[CLIENT] SHA-256 calcolato: %s\n", resp.hash);
+            code = EXIT_FAILURE;
+        }
+    }
 
-    detach_shared_memory(shmaddr);
-    remove_shared_memory(shmid);
-    printf("[CLIENT] Operazione completata.\n");
-    return 0;
+    if (shmaddr) {
+        detach_shared_memory(shmaddr);
+        remove_shared_memory(shmid);
+    }
+    INFO("[CLIENT] Operazione completata.\n");
+    return code;
 }
@@ -1,4 +1,4 @@
-// control_client.c – Modifica dinamicamente il numero massimo di worker del server
+// control_client.c – Modifica dinamicamente la configurazione del server e ne legge le statistiche
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,44 +7,133 @@
 #include <sys/ipc.h>
 #include <sys/msg.h>
 #include "ipc/msg_utils.h"
+#include "ipc/shm_utils.h"
+#include "ipc/stats_utils.h"
+#include "ipc/shard_utils.h"
 
-#define MSG_KEY 0x5678
-#define CONTROL_TYPE 99
+#define CLIENT_TYPE 1       // i comandi viaggiano sulla stessa coda letta dal loop del server
+
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n namespace] [-s shard] <max_workers>\n", prog);
+    fprintf(stderr, "       %s [-n namespace] [-s shard] affinity on [lista_cpu] | off\n", prog);
+    fprintf(stderr, "       %s [-n namespace] [-s shard] stats\n", prog);
+    fprintf(stderr, "Senza -s il comando vale per tutti gli shard del namespace.\n");
+}
+
+// Statistiche di uno shard (lettura diretta dalla shm del server) e suo carico corrente
+int stampa_stats_shard(int ns, int shard, const struct load_table *table) {
+    struct server_stats *stats = attach_stats(ipc_keys_for(ns, shard).shm_key);
+    if (!stats) return -1;
+
+    printf("== shard %d (namespace %d) ==\n", shard, ns);
+    if (table) {
+        const struct shard_load *l = &table->shards[shard];
+        printf("pid:                %d\n", l->pid);
+        printf("active_uploads:     %u\n", l->active_uploads);
+        printf("pending:            %u\n", l->pending);
+        printf("queued_bytes:       %llu\n", l->queued_bytes);
+    }
+    print_stats(stats);
+    detach_shared_memory(stats);
+    return 0;
+}
+
+// Invia un messaggio di controllo alla coda di uno shard
+int invia_a_shard(int ns, int shard, struct message *msg) {
+    int msgid = create_message_queue(ipc_keys_for(ns, shard).msg_key);
+    if (msgid == -1) {
+        perror("msgget");
+        return -1;
+    }
+    if (send_message(msgid, msg) == -1) {
+        perror("msgsnd");
+        return -1;
+    }
+    return 0;
+}
 
 int main(int argc, char *argv[]) {
     // ===================== PARSING ARGOMENTI =====================
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <max_workers>\n", argv[0]);
+    int ns = ipc_default_namespace();
+    int only_shard = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "+n:s:")) != -1) {
+        if (opt == 'n' && (ns = ipc_parse_namespace(optarg)) >= 0) continue;
+        if (opt == 's' && (only_shard = atoi(optarg)) >= 0 && only_shard < MAX_SHARDS) continue;
+        usage(argv[0]);
         return EXIT_FAILURE;
     }
+    argc -= optind - 1;
+    argv += optind - 1;
 
-    char *endptr;
-    long new_limit = strtol(argv[1], &endptr, 10);
-    if (*endptr != '\0' || new_limit <= 0) {
-        fprintf(stderr, "max_workers must be un intero positivo\n");
+    if (argc < 2) {
+        usage(argv[0]);
         return EXIT_FAILURE;
     }
 
-    // ===================== APERTURA CODA MESSAGGI =====================
-    int msgid = create_message_queue(MSG_KEY);
-    if (msgid == -1) {
-        perror("msgget");
-        return EXIT_FAILURE;
+    // ===================== SHARD DESTINATARI =====================
+    struct load_table *table = attach_load_table(ns);
+    int nshards = (table && table->nshards >= 1 && table->nshards <= MAX_SHARDS) ? table->nshards : 1;
+    int first = (only_shard >= 0) ? only_shard : 0;
+    int last = (only_shard >= 0) ? only_shard : nshards - 1;
+
+    // ===================== STATISTICHE =====================
+    if (strcmp(argv[1], "stats") == 0) {
+        int ret = EXIT_SUCCESS;
+        for (int i = first; i <= last; ++i) {
+            if (stampa_stats_shard(ns, i, table) == -1) ret = EXIT_FAILURE;
+        }
+        if (table) detach_shared_memory(table);
+        return ret;
     }
+    if (table) detach_shared_memory(table);
 
     // ===================== PREPARAZIONE MESSAGGIO DI CONTROLLO =====================
     struct message msg;
-    msg.mtype = CONTROL_TYPE;
+    memset(&msg, 0, sizeof(msg));
+    msg.mtype = CLIENT_TYPE;
     msg.pid = getpid();
-    msg.filesize = (size_t)new_limit;
-    memset(msg.hash, 0, sizeof(msg.hash)); // non usato
 
-    // ===================== INVIO MESSAGGIO AL SERVER =====================
-    if (send_message(msgid, &msg) == -1) {
-        perror("msgsnd");
-        return EXIT_FAILURE;
+    if (strcmp(argv[1], "affinity") == 0) {
+        if (argc < 3 || argc > 4 || (strcmp(argv[2], "on") != 0 && strcmp(argv[2], "off") != 0) ||
+            (argc == 4 && strcmp(argv[2], "on") != 0)) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (argc == 4 && strlen(argv[3]) >= sizeof(msg.hash)) {
+            fprintf(stderr, "lista CPU troppo lunga\n");
+            return EXIT_FAILURE;
+        }
+
+        msg.op = OP_CTRL_SET_AFFINITY;
+        msg.filesize = (strcmp(argv[2], "on") == 0) ? 1 : 0;
+        if (argc == 4) strcpy(msg.hash, argv[3]);
+    } else {
+        if (argc != 2) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        char *endptr;
+        long new_limit = strtol(argv[1], &endptr, 10);
+        if (*endptr != '\0' || new_limit <= 0) {
+            fprintf(stderr, "max_workers must be un intero positivo\n");
+            return EXIT_FAILURE;
+        }
+
+        msg.op = OP_CTRL_SET_WORKERS;
+        msg.filesize = (size_t)new_limit;
     }
 
-    printf("Inviato nuovo limite al server: %ld worker\n", new_limit);
+    // ===================== INVIO MESSAGGIO AGLI SHARD =====================
+    for (int i = first; i <= last; ++i) {
+        if (invia_a_shard(ns, i, &msg) == -1) return EXIT_FAILURE;
+    }
+
+    if (msg.op == OP_CTRL_SET_WORKERS) {
+        printf("Inviato nuovo limite al server: %zu worker\n", msg.filesize);
+    } else {
+        printf("Inviata configurazione affinity al server: %s %s\n", msg.filesize ? "on" : "off", msg.hash);
+    }
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
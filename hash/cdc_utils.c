@@ -0,0 +1,44 @@
+#include "cdc_utils.h"
+#include <stdint.h>
+
+// Maschere sui bit alti dell'hash: più restrittiva prima della dimensione media,
+// più permissiva dopo (normalized chunking), così le dimensioni si concentrano attorno alla media
+#define CDC_MASK_S 0xFFFE000000000000ULL   // 15 bit
+#define CDC_MASK_L 0xFFE0000000000000ULL   // 11 bit
+
+static uint64_t gear[256];
+static int gear_ready = 0;
+
+// ---- TABELLA GEAR (deterministica: splitmix64 con seme fisso) ----
+static void init_gear(void) {
+    uint64_t x = 0x5348413235364344ULL;
+
+    for (int i = 0; i < 256; ++i) {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        gear[i] = z ^ (z >> 31);
+    }
+    gear_ready = 1;
+}
+
+// ---- RICERCA CONFINE ----
+size_t cdc_next_boundary(const unsigned char* data, size_t len) {
+    if (!gear_ready) init_gear();
+    if (len <= CDC_MIN_CHUNK) return len;
+    if (len > CDC_MAX_CHUNK) len = CDC_MAX_CHUNK;
+
+    size_t normal = (len < CDC_AVG_CHUNK) ? len : CDC_AVG_CHUNK;
+    uint64_t h = 0;
+    size_t i = CDC_MIN_CHUNK;
+
+    for (; i < normal; ++i) {
+        h = (h << 1) + gear[data[i]];
+        if (!(h & CDC_MASK_S)) return i + 1;
+    }
+    for (; i < len; ++i) {
+        h = (h << 1) + gear[data[i]];
+        if (!(h & CDC_MASK_L)) return i + 1;
+    }
+    return len;
+}
@@ -0,0 +1,17 @@
+#ifndef CDC_UTILS_H
+#define CDC_UTILS_H
+
+#include <stddef.h>
+
+// Dimensioni dei chunk content-defined (FastCDC con normalizzazione).
+// Il massimo coincide con la dimensione del segmento condiviso del client
+#define CDC_MIN_CHUNK 2048
+#define CDC_AVG_CHUNK 8192
+#define CDC_MAX_CHUNK 65536
+
+// Ritorna la lunghezza del prossimo chunk a partire da `data` (al più `len` byte).
+// Il confine dipende solo dal contenuto (Gear rolling hash): un'inserzione nel file
+// sposta solo i confini vicini e i chunk successivi restano identici
+size_t cdc_next_boundary(const unsigned char* data, size_t len);
+
+#endif
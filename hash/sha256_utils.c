@@ -83,3 +83,46 @@ void compute_sha256_from_file(const char* path, char* output_hash) {
     }
     output_hash[64] = '\0';
 }
+
+// ---- SHA256 INCREMENTALE ----
+int sha256_stream_init(struct sha256_stream* s) {
+    if (SHA256_Init(&s->ctx) != 1) {
+        printf("SHA256_Init failed\n");
+        return 0;
+    }
+    return 1;
+}
+
+int sha256_stream_update(struct sha256_stream* s, const void* data, size_t len) {
+    if (SHA256_Update(&s->ctx, data, len) != 1) {
+        printf("SHA256_Update failed\n");
+        return 0;
+    }
+    return 1;
+}
+
+int sha256_stream_final(struct sha256_stream* s, char* output_hash) {
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+
+    if (SHA256_Final(hash, &s->ctx) != 1) {
+        printf("SHA256_Final failed\n");
+        output_hash[0] = '\0';
+        return 0;
+    }
+
+    // ---- CONVERSIONE HASH IN STRINGA ESADECIMALE ----
+    for (int i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
+        sprintf(output_hash + (i * 2), "%02x", hash[i]);
+    }
+    output_hash[64] = '\0';
+    return 1;
+}
+
+// ---- VALIDAZIONE DIGEST ESADECIMALE ----
+int sha256_hex_valid(const char* hex) {
+    for (int i = 0; i < 64; ++i) {
+        char c = hex[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return 0;
+    }
+    return hex[64] == '\0';
+}
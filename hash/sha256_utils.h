@@ -2,6 +2,12 @@
 #define SHA256_UTILS_H
 
 #include <stddef.h>
+#include <openssl/sha.h>
+
+// Stato per il calcolo incrementale (dati ricevuti a pezzi)
+struct sha256_stream {
+    SHA256_CTX ctx;
+};
 
 // Calcola l'hash SHA-256 di un blocco di dati in memoria (buffer)
 // `output_hash` deve avere almeno 65 byte (64 caratteri esadecimali + 1 per il terminatore null)
@@ -11,4 +17,14 @@ void compute_sha256(const unsigned char* data, size_t len, char* output_hash);
 // `output_hash` deve avere almeno 65 byte (64 caratteri esadecimali + 1 per il terminatore null)
 void compute_sha256_from_file(const char* path, char* output_hash);
 
+// 1 se `hex` è un digest SHA-256 esadecimale valido (64 caratteri minuscoli + terminatore).
+// I digest ricevuti via IPC vanno validati prima di usarli (es. come nomi di file)
+int sha256_hex_valid(const char* hex);
+
+// Calcolo incrementale: init, update per ogni blocco, final scrive l'hash esadecimale.
+// Ritornano 1 in caso di successo, 0 in caso di errore (come l'API OpenSSL sottostante)
+int sha256_stream_init(struct sha256_stream* s);
+int sha256_stream_update(struct sha256_stream* s, const void* data, size_t len);
+int sha256_stream_final(struct sha256_stream* s, char* output_hash);
+
 #endif
@@ -1,6 +1,7 @@
 #include "msg_utils.h"
 #include <sys/msg.h>
 #include <stdio.h>
+#include <errno.h>
 
 // ---- CREAZIONE CODA ----
 int create_message_queue(key_t key) {
@@ -11,11 +12,23 @@ int create_message_queue(key_t key) {
     return msgid;
 }
 
+// ---- APERTURA CODA ESISTENTE ----
+int attach_message_queue(key_t key) {
+    int msgid = msgget(key, 0);
+    if (msgid == -1 && errno != ENOENT) {
+        perror("msgget failed");
+    }
+    return msgid;
+}
+
 // ---- INVIO MESSAGGIO ----
 int send_message(int msgid, struct message* msg) {
-    if (msgsnd(msgid, msg, sizeof(struct message) - sizeof(long), 0) == -1) {
-        perror("msgsnd failed");
-        return -1;
+    // Con la coda piena msgsnd attende: un segnale che la interrompe non annulla l'invio
+    while (msgsnd(msgid, msg, sizeof(struct message) - sizeof(long), 0) == -1) {
+        if (errno != EINTR) {
+            perror("msgsnd failed");
+            return -1;
+        }
     }
     return 0;
 }
@@ -24,7 +37,17 @@ int send_message(int msgid, struct message* msg) {
 int receive_message(int msgid, long mtype, struct message* msg) {
     ssize_t ret = msgrcv(msgid, msg, sizeof(struct message) - sizeof(long), mtype, 0);
     if (ret == -1) {
-        perror("msgrcv failed");
+        if (errno != EINTR) perror("msgrcv failed");   // interruzione da segnale: decide il chiamante
+        return -1;
+    }
+    return 0;
+}
+
+// ---- RICEZIONE MESSAGGIO NON BLOCCANTE ----
+int receive_message_nowait(int msgid, long mtype, struct message* msg) {
+    ssize_t ret = msgrcv(msgid, msg, sizeof(struct message) - sizeof(long), mtype, IPC_NOWAIT);
+    if (ret == -1) {
+        if (errno != ENOMSG) perror("msgrcv failed");
         return -1;
     }
     return 0;
@@ -4,6 +4,56 @@
 #include <sys/ipc.h>
 #define HASH_SIZE 65
 
+// Segmento multi-slot del client in modalità zero-copy: il server hasha lo slot in place
+// e con l'ack lo restituisce al client, che nel frattempo riempie gli altri slot
+#define ZC_SLOTS 4
+#define ZC_SLOT_SIZE 65536
+
+// Operazioni (campo op): 0 = chunk di upload classico
+#define OP_UPLOAD 0
+#define OP_CDC_ANNOUNCE 1           // filesize = numero di struct cdc_record nella shm, chunk_id = primo chunk
+#define OP_CDC_DATA 2               // dati dei chunk mancanti nella shm, uno dopo l'altro: total_chunks = quanti,
+                                    // filesize = byte totali (nell'ack: hash = bitmap dei chunk mancanti)
+#define OP_CDC_REJECT 3             // solo ack: chunk rifiutato, upload annullato
+#define OP_ZEROCOPY 4               // chunk nello slot (chunk_id % ZC_SLOTS) del segmento multi-slot
+#define OP_ZC_REJECT 5              // solo ack: segmento o chunk zero-copy non valido, upload annullato
+#define OP_VERIFY_BEGIN 6           // prima dei chunk: hash = digest atteso dell'intero file,
+                                    // total_chunks = 1 se il file fa parte di una verifica batch
+#define OP_VERIFY_OK 7              // solo risposta: digest calcolato uguale all'atteso (hash non incluso)
+#define OP_VERIFY_MISMATCH 8        // risposta: digest diverso (hash = calcolato);
+                                    // ack: verifica interrotta su un chunk diverso dall'atteso
+#define OP_PING 9                   // calibrazione del client: il server risponde subito, senza ammissione;
+                                    // filesize = istante di invio in us (CLOCK_MONOTONIC)
+#define OP_VERIFY_RESULT 10         // worker -> loop dello shard: esito di un file batch (filesize = 1 se OK)
+#define OP_VERIFY_END 11            // fine della verifica batch: filesize = file inviati allo shard;
+                                    // nel riepilogo chunk_id = file OK, total_chunks = file falliti
+#define OP_CTRL_SET_WORKERS 12      // filesize = nuovo max_workers
+#define OP_CTRL_SET_AFFINITY 13     // filesize = 1 on / 0 off, hash = lista CPU opzionale
+
+// Tipo della risposta a un ping: distinto dal PID, così una risposta in ritardo
+// non viene scambiata per l'ack di un chunk
+#define PING_REPLY_TYPE(pid) ((long)(pid) | (1L << 30))
+
+// Attesa massima del client per la risposta a un ping. Il server scarta i ping più vecchi
+// di metà di questo tempo: una risposta che parte ha ancora il tempo di arrivare prima che
+// il client rinunci e la scarti, invece di restare nella coda senza destinatario
+#define PING_TIMEOUT_US 200000
+
+// Tipo dei messaggi di una verifica batch: il server risponde solo ai file falliti
+// (OP_VERIFY_MISMATCH, seq = file) e a fine batch con un riepilogo (OP_VERIFY_END).
+// Essendo distinti dagli ack, possono arrivare mentre il client invia già i file successivi
+#define VERIFY_REPLY_TYPE(pid) ((long)(pid) | (1L << 29))
+
+// Annunci CDC a blocchi: il client scrive nella shm fino a CDC_BATCH record (lunghezza e digest)
+// e il server risponde con un solo ack che porta in `hash` la bitmap dei chunk che non ha
+// (bit i = record i) e in filesize il loro numero. La bitmap (CDC_BATCH / 8 byte) sta in HASH_SIZE
+#define CDC_BATCH 256
+
+struct cdc_record {
+    unsigned int len;
+    char digest[HASH_SIZE];
+};
+
 struct message {
     long mtype;
     pid_t pid;
@@ -13,11 +63,18 @@ struct message {
     unsigned int total_chunks;  // numero totale di chunk
     int last_chunk;             // 1 se ultimo chunk, 0 altrimenti
     key_t shm_key;              // CHIAVE MEMORIA CONDIVISA DEL CLIENT
+    unsigned int backoff_ms;    // BACKPRESSURE: attesa suggerita al client prima del prossimo chunk (solo ack)
+    int op;                     // OPERAZIONE RICHIESTA (OP_*)
+    unsigned int seq;           // numero della richiesta del client (un file = una richiesta), per il tracing
 };
 
 int create_message_queue(key_t key);
+// Apre la coda di un server già avviato (senza crearla); -1 se non esiste
+int attach_message_queue(key_t key);
 int send_message(int msgid, struct message* msg);
 int receive_message(int msgid, long mtype, struct message* msg);
+// Come receive_message ma non bloccante: ritorna -1 se non ci sono messaggi del tipo richiesto
+int receive_message_nowait(int msgid, long mtype, struct message* msg);
 void remove_message_queue(int msgid);
 #endif
 
@@ -1,7 +1,9 @@
+#define _GNU_SOURCE
 #include "sem_utils.h"
 #include <sys/sem.h>
 #include <stdio.h>
 #include <errno.h>
+#include <time.h>
 
 // ---- WAIT SEMAFORO ----
 void sem_wait(int semid, int semnum) {
@@ -9,9 +11,29 @@ void sem_wait(int semid, int semnum) {
     op.sem_num = semnum;
     op.sem_op = -1;
     op.sem_flg = 0;
-    if (semop(semid, &op, 1) == -1) {
-        perror("semop wait failed");
+    // Un segnale (es. il dump del tracing) interrompe l'attesa: si riprova, il chiamante
+    // prosegue convinto di avere il semaforo
+    while (semop(semid, &op, 1) == -1) {
+        if (errno != EINTR) {
+            perror("semop wait failed");
+            return;
+        }
+    }
+}
+
+// ---- WAIT SEMAFORO CON TIMEOUT ----
+int sem_wait_timeout(int semid, int semnum, long timeout_ms) {
+    struct sembuf op;
+    op.sem_num = semnum;
+    op.sem_op = -1;
+    op.sem_flg = 0;
+
+    struct timespec timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+    if (semtimedop(semid, &op, 1, &timeout) == -1) {
+        if (errno != EAGAIN && errno != EINTR) perror("semtimedop wait failed");
+        return -1;
     }
+    return 0;
 }
 
 // ---- SIGNAL SEMAFORO ----
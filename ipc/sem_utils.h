@@ -8,6 +8,10 @@ int create_semaphore_set(key_t key, int num_sems);
 // Attende (P) su un semaforo
 void sem_wait(int semid, int semnum);
 
+// Attende (P) su un semaforo per al massimo `timeout_ms` millisecondi.
+// Ritorna 0 se il semaforo è stato acquisito, -1 allo scadere del timeout (o in caso di errore)
+int sem_wait_timeout(int semid, int semnum, long timeout_ms);
+
 // Segnala (V) su un semaforo
 void sem_signal(int semid, int semnum);
 
@@ -0,0 +1,127 @@
+#include "shard_utils.h"
+#include "shm_utils.h"
+#include <sys/shm.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <errno.h>
+
+// ---- NAMESPACE DI DEFAULT ----
+int ipc_default_namespace(void) {
+    const char* env = getenv(IPC_NAMESPACE_ENV);
+    if (!env) return 0;
+
+    int ns = ipc_parse_namespace(env);
+    if (ns < 0) {
+        fprintf(stderr, "%s non valida, uso il namespace 0\n", IPC_NAMESPACE_ENV);
+        return 0;
+    }
+    return ns;
+}
+
+// ---- PARSING NAMESPACE ----
+int ipc_parse_namespace(const char* s) {
+    char* end;
+    long ns = strtol(s, &end, 0);
+    if (*s == '\0' || *end != '\0' || ns < 0 || ns > MAX_NAMESPACE) return -1;
+    return (int)ns;
+}
+
+// ---- CHIAVI DI UNO SHARD ----
+struct ipc_keys ipc_keys_for(int ns, int shard) {
+    key_t offset = (key_t)(ns * IPC_NAMESPACE_STRIDE + shard * IPC_SHARD_STRIDE);
+    struct ipc_keys keys = {
+        BASE_SHM_KEY + offset,
+        BASE_MSG_KEY + offset,
+        BASE_SEM_KEY + offset
+    };
+    return keys;
+}
+
+// ---- CHIAVE SEGMENTO CLIENT ----
+key_t ipc_client_shm_key(int ns, pid_t pid) {
+    // Bit 30 acceso: fuori dallo spazio delle chiavi dei server (< 0x40000000)
+    return (key_t)(0x40000000 | ((ns & 0x3F) << 23) | (pid & 0x7FFFFF));
+}
+
+// ---- CHIAVE TABELLA CARICHI ----
+key_t ipc_load_key(int ns) {
+    return (key_t)(BASE_LOAD_KEY + ns * IPC_NAMESPACE_STRIDE);
+}
+
+// ---- CREAZIONE TABELLA CARICHI ----
+struct load_table* create_load_table(int ns, int* shmid_out) {
+    int shmid = create_shared_memory(ipc_load_key(ns), sizeof(struct load_table));
+    if (shmid == -1) return NULL;
+
+    if (shmid_out) *shmid_out = shmid;
+    return attach_shared_memory(shmid);
+}
+
+// ---- COLLEGAMENTO TABELLA CARICHI ----
+struct load_table* attach_load_table(int ns) {
+    int shmid = shmget(ipc_load_key(ns), 0, 0);
+    if (shmid == -1) return NULL;   // nessun server nel namespace: shard 0
+    return attach_shared_memory(shmid);
+}
+
+// ---- HASH FNV-1a 64 BIT ----
+static uint64_t fnv1a(const char* s, uint64_t seed) {
+    uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+    for (; *s; ++s) {
+        h ^= (unsigned char)*s;
+        h *= 0x100000001b3ULL;
+    }
+    // Finalizzazione: diffonde anche le differenze del solo seme
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// ---- SHARD ATTIVO ----
+static int shard_alive(const struct shard_load* s) {
+    return s->pid != 0 && !(kill(s->pid, 0) == -1 && errno == ESRCH);
+}
+
+// ---- ROUTING RENDEZVOUS ----
+int shard_for_key(const struct load_table* table, const char* routing_key) {
+    int nshards = (table->nshards >= 1 && table->nshards <= MAX_SHARDS) ? table->nshards : 1;
+    int best = -1;
+    uint64_t best_score = 0;
+
+    for (int i = 0; i < nshards; ++i) {
+        if (!shard_alive(&table->shards[i])) continue;
+
+        uint64_t score = fnv1a(routing_key, (uint64_t)(i + 1) * 0x9E3779B97F4A7C15ULL);
+        if (best == -1 || score > best_score) {
+            best = i;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+// ---- SHARD MENO CARICO ----
+int least_loaded_shard(const struct load_table* table) {
+    int best = -1;
+
+    for (int i = 0; i < table->nshards && i < MAX_SHARDS; ++i) {
+        const struct shard_load* s = &table->shards[i];
+        if (!shard_alive(s)) continue;
+
+        if (best == -1) {
+            best = i;
+            continue;
+        }
+
+        const struct shard_load* b = &table->shards[best];
+        unsigned int load = s->active_uploads + s->pending;
+        unsigned int best_load = b->active_uploads + b->pending;
+        if (load < best_load || (load == best_load && s->queued_bytes < b->queued_bytes)) {
+            best = i;
+        }
+    }
+    return best;
+}
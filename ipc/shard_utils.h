@@ -0,0 +1,68 @@
+#ifndef SHARD_UTILS_H
+#define SHARD_UTILS_H
+#include <sys/types.h>
+#include <sys/ipc.h>
+
+// Chiavi IPC di base (namespace 0, shard 0): coincidono con quelle storiche del progetto
+#define BASE_SHM_KEY 0x1234
+#define BASE_MSG_KEY 0x5678
+#define BASE_SEM_KEY 0x9ABC
+#define BASE_LOAD_KEY 0x2468
+
+// Distanza tra le chiavi di namespace e di shard diversi
+#define IPC_NAMESPACE_STRIDE 0x100000
+#define IPC_SHARD_STRIDE 0x100
+#define MAX_NAMESPACE 0x3FF
+#define MAX_SHARDS 64
+
+// Variabile d'ambiente con il namespace di default (sovrascrivibile con -n)
+#define IPC_NAMESPACE_ENV "SHA256_IPC_NS"
+
+// Chiavi di uno shard
+struct ipc_keys {
+    key_t shm_key;      // segmento del server (statistiche)
+    key_t msg_key;      // coda messaggi dello shard
+    key_t sem_key;      // semafori SEM_MEM / SEM_PROC dello shard
+};
+
+// Carico di uno shard, aggiornato dal suo loop principale
+struct shard_load {
+    pid_t pid;                          // 0 = shard non attivo
+    unsigned int active_uploads;
+    unsigned int pending;               // richieste in coda pendente
+    unsigned long long queued_bytes;    // byte nelle richieste in coda pendente
+};
+
+// Tabella dei carichi di un namespace, in memoria condivisa (BASE_LOAD_KEY + namespace)
+struct load_table {
+    int nshards;
+    struct shard_load shards[MAX_SHARDS];
+};
+
+// Namespace di default: IPC_NAMESPACE_ENV se valida, altrimenti 0
+int ipc_default_namespace(void);
+
+// Converte una stringa in namespace; -1 se non valida
+int ipc_parse_namespace(const char* s);
+
+// Chiavi dello shard `shard` nel namespace `ns`
+struct ipc_keys ipc_keys_for(int ns, int shard);
+
+// Chiave del segmento del client `pid` nel namespace `ns` (disgiunta dalle chiavi dei server)
+key_t ipc_client_shm_key(int ns, pid_t pid);
+
+// Chiave della tabella dei carichi del namespace
+key_t ipc_load_key(int ns);
+
+// Crea (server) o collega (client) la tabella dei carichi; NULL se assente
+struct load_table* create_load_table(int ns, int* shmid_out);
+struct load_table* attach_load_table(int ns);
+
+// Routing per hashing consistente (rendezvous) tra gli shard attivi: se uno shard termina
+// solo le sue chiavi passano ad altri shard. -1 se nessuno shard risulta attivo
+int shard_for_key(const struct load_table* table, const char* routing_key);
+
+// Shard attivo con il carico minimo; -1 se nessuno shard risulta attivo
+int least_loaded_shard(const struct load_table* table);
+
+#endif
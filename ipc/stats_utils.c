@@ -0,0 +1,37 @@
+#include "stats_utils.h"
+#include "shm_utils.h"
+#include <sys/shm.h>
+#include <stdio.h>
+
+// ---- ATTACCO STATISTICHE ESISTENTI ----
+struct server_stats* attach_stats(key_t key) {
+    int shmid = shmget(key, 0, 0);
+    if (shmid == -1) {
+        perror("shmget failed (server non avviato?)");
+        return NULL;
+    }
+    return attach_shared_memory(shmid);
+}
+
+// ---- INCREMENTO ATOMICO ----
+void stats_add(unsigned long long* counter, unsigned long long value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+// ---- STAMPA ----
+void print_stats(const struct server_stats* stats) {
+    printf("max_workers:        %d\n", stats->max_workers);
+    printf("affinity:           %s\n", stats->affinity_enabled ? "on" : "off");
+    printf("numa_nodes:         %d\n", stats->numa_nodes);
+    printf("uploads_completed:  %llu\n", stats->uploads_completed);
+    printf("bytes_received:     %llu\n", stats->bytes_received);
+    printf("bytes_deduplicated: %llu\n", stats->bytes_deduplicated);
+    printf("dispatch_local:     %llu\n", stats->dispatch_local);
+    printf("dispatch_remote:    %llu\n", stats->dispatch_remote);
+    printf("dispatch_unknown:   %llu\n", stats->dispatch_unknown);
+    printf("bytes_local:        %llu\n", stats->bytes_local);
+    printf("bytes_remote:       %llu\n", stats->bytes_remote);
+    printf("verify_ok:          %llu\n", stats->verify_ok);
+    printf("verify_failed:      %llu\n", stats->verify_failed);
+    printf("verify_early_abort: %llu\n", stats->verify_early_abort);
+}
@@ -0,0 +1,33 @@
+#ifndef STATS_UTILS_H
+#define STATS_UTILS_H
+#include <sys/types.h>
+#include <sys/ipc.h>
+
+// Statistiche del server, pubblicate nel suo segmento di memoria condivisa (SHM_KEY)
+struct server_stats {
+    int max_workers;
+    int affinity_enabled;                  // 1 se i worker vengono fissati sulle CPU
+    int numa_nodes;                        // nodi NUMA con CPU nel pool dei worker
+    unsigned long long uploads_completed;
+    unsigned long long bytes_received;
+    unsigned long long bytes_deduplicated; // byte di chunk CDC già presenti nello store (non trasferiti)
+    unsigned long long dispatch_local;     // worker sullo stesso nodo del segmento client
+    unsigned long long dispatch_remote;    // worker su un nodo diverso
+    unsigned long long dispatch_unknown;   // nodo del segmento o del worker non determinabile
+    unsigned long long bytes_local;        // byte hashati su memoria del nodo del worker
+    unsigned long long bytes_remote;       // byte hashati attraversando i nodi
+    unsigned long long verify_ok;
+    unsigned long long verify_failed;
+    unsigned long long verify_early_abort;   // verifiche interrotte al primo chunk diverso dal manifest atteso
+};
+
+// Collega le statistiche di un server già avviato (senza creare il segmento)
+struct server_stats* attach_stats(key_t key);
+
+// Incremento atomico: i contatori sono aggiornati anche dai worker
+void stats_add(unsigned long long* counter, unsigned long long value);
+
+// Stampa le statistiche in formato leggibile
+void print_stats(const struct server_stats* stats);
+
+#endif
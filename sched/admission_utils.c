@@ -0,0 +1,41 @@
+#include "admission_utils.h"
+
+// ---- SECONDI TRASCORSI TRA DUE ISTANTI ----
+static double elapsed_seconds(const struct timespec* from, const struct timespec* to) {
+    return (double)(to->tv_sec - from->tv_sec) + (double)(to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+// ---- INIZIALIZZAZIONE BUCKET ----
+void bucket_init(struct client_bucket* b, double burst, double weight) {
+    b->tokens = burst;
+    clock_gettime(CLOCK_MONOTONIC, &b->last_refill);
+    b->inflight = 0;
+    b->weight = (weight > 0) ? weight : 1.0;
+    b->last_finish = 0;
+}
+
+// ---- REFILL E CONSUMO TOKEN ----
+unsigned int bucket_consume(struct client_bucket* b, size_t bytes, double rate, double burst) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    // Ricarica proporzionale al tempo trascorso, senza superare il burst
+    b->tokens += rate * elapsed_seconds(&b->last_refill, &now);
+    if (b->tokens > burst) b->tokens = burst;
+    b->last_refill = now;
+
+    // Il chunk è già in memoria condivisa: lo si accetta comunque e si accumula debito
+    b->tokens -= (double)bytes;
+    if (b->tokens >= 0 || rate <= 0) return 0;
+
+    return (unsigned int)(-b->tokens / rate * 1000.0) + 1;
+}
+
+// ---- TAG WFQ (START-TIME FAIR QUEUING) ----
+double wfq_tag(struct client_bucket* b, double vtime, size_t bytes, double* start_tag) {
+    double start = (b->last_finish > vtime) ? b->last_finish : vtime;
+    b->last_finish = start + (double)bytes / b->weight;
+
+    if (start_tag) *start_tag = start;
+    return b->last_finish;
+}
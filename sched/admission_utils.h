@@ -0,0 +1,26 @@
+#ifndef ADMISSION_UTILS_H
+#define ADMISSION_UTILS_H
+#include <stddef.h>
+#include <time.h>
+
+// Stato di ammissione per client: token bucket sui byte/s, chunk in volo e tag WFQ
+struct client_bucket {
+    double tokens;                // byte disponibili nel bucket (negativo = debito)
+    struct timespec last_refill;  // istante dell'ultimo refill
+    unsigned int inflight;        // chunk ricevuti e ancora in coda pendente
+    double weight;                // peso del client nel weighted fair queuing
+    double last_finish;           // ultimo tag di fine virtuale assegnato
+};
+
+// Inizializza il bucket pieno (il burst è disponibile subito)
+void bucket_init(struct client_bucket* b, double burst, double weight);
+
+// Consuma `bytes` dal bucket ricaricato a `rate` byte/s fino a `burst`.
+// Ritorna i millisecondi di attesa da suggerire al client (0 = nessun backpressure)
+unsigned int bucket_consume(struct client_bucket* b, size_t bytes, double rate, double burst);
+
+// Assegna il tag di fine virtuale WFQ a una richiesta di `bytes` byte.
+// `start_tag` (se non NULL) riceve il tag di inizio, da usare per avanzare il tempo virtuale
+double wfq_tag(struct client_bucket* b, double vtime, size_t bytes, double* start_tag);
+
+#endif
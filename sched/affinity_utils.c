@@ -0,0 +1,211 @@
+#define _GNU_SOURCE
+#include "affinity_utils.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+// ---- TOPOLOGIA (stato del processo) ----
+static int cpu_node[CPU_SETSIZE];           // nodo di ogni CPU
+static cpu_set_t pool;                      // CPU utilizzabili dai worker
+static int pool_size = 0;
+static int next_cpu[AFFINITY_MAX_NODES + 1]; // cursore round robin per nodo (+1 = pool intero)
+
+// ---- PARSING LISTA CPU ("0-3,8") ----
+static int parse_cpulist(const char* list, cpu_set_t* out) {
+    CPU_ZERO(out);
+    const char* p = list;
+
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= CPU_SETSIZE) return -1;
+
+        long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first || last >= CPU_SETSIZE) return -1;
+        }
+
+        for (long c = first; c <= last; ++c) CPU_SET((int)c, out);
+
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        p = end;
+    }
+    return 0;
+}
+
+// ---- LETTURA NODO DI UNA CPU DA SYSFS ----
+static int read_cpu_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+    DIR* dir = opendir(path);
+    if (!dir) return 0;
+
+    int node = 0;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strncmp(ent->d_name, "node", 4) == 0 && ent->d_name[4] >= '0' && ent->d_name[4] <= '9') {
+            node = atoi(ent->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+
+    return (node < AFFINITY_MAX_NODES) ? node : 0;
+}
+
+// ---- INIZIALIZZAZIONE TOPOLOGIA ----
+int affinity_init(const char* cpulist) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+        perror("sched_getaffinity failed");
+        return -1;
+    }
+
+    if (cpulist && *cpulist) {
+        cpu_set_t requested;
+        if (parse_cpulist(cpulist, &requested) == -1) {
+            fprintf(stderr, "Lista CPU non valida: %s\n", cpulist);
+            return -1;
+        }
+        CPU_AND(&allowed, &allowed, &requested);
+    }
+
+    if (CPU_COUNT(&allowed) == 0) return -1;
+
+    pool = allowed;
+    pool_size = CPU_COUNT(&pool);
+    memset(next_cpu, 0, sizeof(next_cpu));
+    for (int c = 0; c < CPU_SETSIZE; ++c) {
+        cpu_node[c] = CPU_ISSET(c, &pool) ? read_cpu_node(c) : -1;
+    }
+    return pool_size;
+}
+
+// ---- NUMERO DI NODI ----
+int affinity_node_count(void) {
+    int seen[AFFINITY_MAX_NODES] = {0};
+    int count = 0;
+
+    for (int c = 0; c < CPU_SETSIZE; ++c) {
+        if (cpu_node[c] >= 0 && CPU_ISSET(c, &pool) && !seen[cpu_node[c]]) {
+            seen[cpu_node[c]] = 1;
+            count++;
+        }
+    }
+    return count;
+}
+
+// ---- NODO DI UNA CPU ----
+int affinity_cpu_node(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE || pool_size == 0) return 0;
+    return (cpu_node[cpu] >= 0) ? cpu_node[cpu] : read_cpu_node(cpu);
+}
+
+// ---- SCELTA CPU ROUND ROBIN ----
+int affinity_pick_cpu(int node) {
+    if (pool_size == 0) return -1;
+
+    int slot = (node >= 0 && node < AFFINITY_MAX_NODES) ? node : AFFINITY_MAX_NODES;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = 0; i < CPU_SETSIZE; ++i) {
+            int c = (next_cpu[slot] + i) % CPU_SETSIZE;
+            if (!CPU_ISSET(c, &pool)) continue;
+            if (slot != AFFINITY_MAX_NODES && cpu_node[c] != node) continue;
+
+            next_cpu[slot] = c + 1;
+            return c;
+        }
+        // Nessuna CPU sul nodo richiesto: ripiega sull'intero pool
+        slot = AFFINITY_MAX_NODES;
+    }
+    return -1;
+}
+
+// ---- BINDING SU UN NODO ----
+int affinity_bind_to_node_index(int index) {
+    int count = affinity_node_count();
+    if (count == 0) return -1;
+
+    // Nodi in ordine crescente: si sceglie il (index % count)-esimo
+    int wanted = index % count;
+    int node = -1;
+    for (int n = 0, seen = 0; n < AFFINITY_MAX_NODES && node < 0; ++n) {
+        for (int c = 0; c < CPU_SETSIZE; ++c) {
+            if (cpu_node[c] == n && CPU_ISSET(c, &pool)) {
+                if (seen++ == wanted) node = n;
+                break;
+            }
+        }
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c = 0; c < CPU_SETSIZE; ++c) {
+        if (cpu_node[c] == node && CPU_ISSET(c, &pool)) CPU_SET(c, &set);
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        perror("sched_setaffinity failed");
+        return -1;
+    }
+
+    pool = set;
+    pool_size = CPU_COUNT(&pool);
+    return node;
+}
+
+// ---- PINNING SU CPU ----
+int affinity_pin_self(int cpu) {
+    if (cpu < 0) return -1;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        perror("sched_setaffinity failed");
+        return -1;
+    }
+    return 0;
+}
+
+// ---- POLITICA DI ALLOCAZIONE MEMORIA ----
+int affinity_prefer_node(int node) {
+    // Syscall diretta: evita la dipendenza da libnuma
+    long ret;
+    if (node < 0 || node >= AFFINITY_MAX_NODES) {
+        ret = syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0);
+    } else {
+        unsigned long mask = 1UL << node;
+        ret = syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8);
+    }
+    return (ret == -1) ? -1 : 0;
+}
+
+// ---- NODO DI UNA PAGINA ----
+int affinity_node_of_address(const void* addr) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    void* page = (void*)((unsigned long)addr & ~(unsigned long)(page_size - 1));
+    int status = -1;
+
+    // move_pages legge solo le tabelle delle pagine del chiamante e non genera page fault:
+    // una pagina appena collegata con shmat risulterebbe assente (-ENOENT). La si legge prima
+    (void)*(volatile const char*)addr;
+
+    // move_pages con nodes == NULL non sposta nulla: riporta solo il nodo corrente della pagina
+    if (syscall(SYS_move_pages, 0, 1UL, &page, NULL, &status, 0) == -1) return -1;
+    return (status >= 0) ? status : -1;
+}
+
+// ---- NODO CORRENTE ----
+int affinity_current_node(void) {
+    int cpu = sched_getcpu();
+    return (cpu >= 0) ? affinity_cpu_node(cpu) : -1;
+}
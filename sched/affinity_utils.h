@@ -0,0 +1,37 @@
+#ifndef AFFINITY_UTILS_H
+#define AFFINITY_UTILS_H
+
+#define AFFINITY_MAX_NODES 64
+
+// Legge la topologia CPU/nodi NUMA da sysfs, limitata alle CPU permesse al processo.
+// `cpulist` (es. "0-3,8") restringe ulteriormente il pool dei worker; NULL o "" = tutte.
+// Ritorna il numero di CPU utilizzabili, -1 se la lista non contiene CPU valide
+int affinity_init(const char* cpulist);
+
+// Numero di nodi NUMA con almeno una CPU utilizzabile
+int affinity_node_count(void);
+
+// Nodo NUMA di una CPU (0 se la topologia non è disponibile)
+int affinity_cpu_node(int cpu);
+
+// Sceglie una CPU (round robin) sul nodo indicato; con node < 0 o nodo senza CPU usa tutto il pool
+int affinity_pick_cpu(int node);
+
+// Fissa il processo chiamante sulle CPU dell'`index`-esimo nodo (modulo il numero di nodi)
+// e restringe il pool a quelle CPU. Ritorna il nodo scelto, -1 in caso di errore
+int affinity_bind_to_node_index(int index);
+
+// Fissa il processo chiamante sulla CPU indicata
+int affinity_pin_self(int cpu);
+
+// Imposta il nodo preferito per le nuove allocazioni del processo (node < 0 = politica di default)
+int affinity_prefer_node(int node);
+
+// Nodo NUMA della pagina che contiene `addr`, -1 se non determinabile.
+// La pagina viene letta (e quindi mappata) prima della richiesta
+int affinity_node_of_address(const void* addr);
+
+// Nodo NUMA della CPU su cui il processo sta girando, -1 se non determinabile
+int affinity_current_node(void);
+
+#endif
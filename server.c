@@ -5,25 +5,55 @@
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
+#include <errno.h>
+#include <time.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/shm.h>
 #include "ipc/shm_utils.h"
 #include "ipc/sem_utils.h"
 #include "ipc/msg_utils.h"
 #include "hash/sha256_utils.h"
+#include "hash/cdc_utils.h"
+#include "sched/admission_utils.h"
+#include "sched/affinity_utils.h"
+#include "ipc/stats_utils.h"
+#include "store/chunk_store_utils.h"
+#include "ipc/shard_utils.h"
+#include "trace/trace_utils.h"
 
-#define SHM_KEY 0x1234
-#define MSG_KEY 0x5678
-#define SEM_KEY 0x9ABC
 #define MAX_WORKERS 5       // valore iniziale, modificabile da control client
 #define SEM_MEM 0           // semaforo per accesso memoria
 #define SEM_PROC 1          // semaforo per numero processi attivi
 #define TMP_PATH_LEN 256
 #define MAX_UPLOADS 64
+#define MAX_CLIENTS 128     // client con stato di ammissione conservato tra un upload e l'altro
+#define WORKER_POLL_MS 5    // attesa massima di un worker libero prima di tornare a leggere la coda
+#define ZC_WORKER_IDLE_S 10 // attesa di un chunk oltre la quale il worker zero-copy controlla che il client esista
+
+// Tipo dei chunk zero-copy inoltrati dal loop al worker dell'upload, nella coda dello shard
+#define ZC_WORKER_TYPE(pid) ((long)(pid) | (1L << 28))
+
+// Parametri di ammissione per client (token bucket e chunk in volo)
+#define ADMISSION_RATE (256.0 * 1024 * 1024)    // byte/s sostenibili da un singolo client
+#define ADMISSION_BURST (8.0 * 1024 * 1024)     // byte accettati a piena velocità prima del throttling
+#define ADMISSION_MAX_INFLIGHT 4                // chunk accodati per client oltre i quali si rallenta
+#define ADMISSION_INFLIGHT_BACKOFF_MS 5         // attesa minima suggerita oltre ADMISSION_MAX_INFLIGHT
+#define WFQ_DEFAULT_WEIGHT 1.0
 
 // ===================== VARIABILI GLOBALI =====================
 int msgid, shmid, semid;
 int max_workers = MAX_WORKERS;
+int affinity_enabled = 0;   // attivabile da control client
+struct server_stats* stats; // pubblicate nel segmento SHM dello shard
+
+// Sharding: namespace delle chiavi, indice dello shard e tabella dei carichi condivisa
+int ipc_ns = 0;
+int shard_id = 0;
+struct load_table* load = NULL;
+int load_shmid = -1;        // >= 0 solo nel processo che ha creato la tabella
+pid_t shard_pids[MAX_SHARDS];
+int num_shards = 1;
 
 // Struttura per tracciare lo stato di upload per ogni client
 struct upload_state {
@@ -31,40 +61,84 @@ struct upload_state {
     char tmp_path[TMP_PATH_LEN];
     size_t received_chunks;
     size_t total_chunks;
+    size_t received_bytes;
+    int node;                       // nodo NUMA del segmento client (-1 = sconosciuto)
+    int data_node;                  // nodo dei dati letti dall'hash: file temporaneo o segmento zero-copy
+    int cdc;                        // 1 se upload content-defined: tmp_path contiene il manifest dei digest
+    void* zc_addr;                  // zero-copy: segmento multi-slot del client (collegato solo nel worker)
+    pid_t zc_worker;                // zero-copy: worker che hasha i chunk dell'upload (0 = nessuno)
+    int verify;                     // 1 se il client ha chiesto la verifica contro `expected`
+    int batch;                      // 1 se la verifica fa parte di un batch: si risponde solo ai fallimenti
+    char expected[HASH_SIZE];
+    char* expected_manifest;        // manifest conservato per `expected`, in memoria: verifica chunk per chunk (CDC)
+    size_t expected_count;          // digest in expected_manifest
+    size_t expected_next;           // prossimo digest atteso
+    struct cdc_record cdc_missing[CDC_BATCH];   // CDC: chunk dell'ultimo annuncio che il server non ha
+    unsigned int cdc_missing_count;
+    unsigned int cdc_missing_next;  // primo chunk mancante non ancora ricevuto
+    int cdc_last;                   // 1 se l'ultimo annuncio conteneva l'ultimo chunk del file
 };
 struct upload_state uploads[MAX_UPLOADS];
 
-// Coda prioritaria per richieste pendenti (ordinata per filesize crescente)
+// Stato di ammissione per client (token bucket + WFQ): indipendente dagli upload, così un client
+// che invia molti file di seguito resta soggetto allo stesso bucket. Nella stessa voce si contano
+// gli esiti della verifica batch in corso, riportati nel riepilogo finale
+struct client_entry {
+    pid_t pid;
+    struct client_bucket bucket;
+    unsigned int batch_ok;
+    unsigned int batch_failed;
+    unsigned int batch_expected;    // file annunciati da OP_VERIFY_END (0 = batch non ancora chiuso)
+    unsigned int batch_end_seq;
+};
+struct client_entry clients[MAX_CLIENTS];
+
+// Coda pendente ordinata per tag di fine virtuale (weighted fair queuing tra client)
 struct pending_request {
     struct message req;
-    size_t filesize;
+    double start_tag;
+    double finish_tag;
+    int waiting_worker;     // 1 dopo il primo passaggio in cui non c'era un worker libero (tracing)
 };
-#define PENDING_QUEUE_SIZE 16
+// Ogni richiesta passa dalla coda: al più ZC_SLOTS chunk in volo per upload
+#define PENDING_QUEUE_SIZE (MAX_UPLOADS * ZC_SLOTS)
 struct pending_request pending_queue[PENDING_QUEUE_SIZE];
 int pending_count = 0;
+unsigned long long pending_bytes = 0;
+double wfq_vtime = 0;       // tempo virtuale: tag di inizio dell'ultima richiesta servita
 
 // ===================== FUNZIONI DI UTILITÀ =====================
 
-void enqueue_pending(const struct message* req) {
-    // Inserimento in ordine crescente di filesize
+// Accoda una richiesta con i suoi tag WFQ; ritorna 0 se la coda è piena
+int enqueue_pending(const struct message* req, double start_tag, double finish_tag) {
+    if (pending_count == PENDING_QUEUE_SIZE) return 0;
+
+    // Inserimento in ordine crescente di tag di fine (a parità resta FIFO)
     int i = pending_count - 1;
 
-    while (i >= 0 && pending_queue[i].filesize > req->filesize) {
+    while (i >= 0 && pending_queue[i].finish_tag > finish_tag) {
         pending_queue[i+1] = pending_queue[i];
         i--;
     }
 
     pending_queue[i+1].req = *req;
-    pending_queue[i+1].filesize = req->filesize;
+    pending_queue[i+1].start_tag = start_tag;
+    pending_queue[i+1].finish_tag = finish_tag;
+    pending_queue[i+1].waiting_worker = 0;
     pending_count++;
+    pending_bytes += req->filesize;
+    return 1;
 }
 
-int dequeue_pending(struct message* out) {
-    if (pending_count == 0) return 0;
+// Estrae la richiesta in posizione `pos` (0 = tag di fine minimo) e avanza il tempo virtuale
+int dequeue_pending(int pos, struct message* out) {
+    if (pos >= pending_count) return 0;
 
-    *out = pending_queue[0].req;
+    *out = pending_queue[pos].req;
+    pending_bytes -= out->filesize;
+    if (pending_queue[pos].start_tag > wfq_vtime) wfq_vtime = pending_queue[pos].start_tag;
 
-    for (int i = 1; i < pending_count; ++i) {
+    for (int i = pos + 1; i < pending_count; ++i) {
         pending_queue[i-1] = pending_queue[i];
     }
 
@@ -72,29 +146,105 @@ int dequeue_pending(struct message* out) {
     return 1;
 }
 
+// Trova o crea lo stato di un client. A tabella piena si ricicla il client
+// servito meno di recente: il suo bucket si sarebbe comunque ricaricato del tutto
+struct client_entry* get_client_entry(pid_t pid) {
+    int slot = -1;
+    for (int i = 0; i < MAX_CLIENTS; ++i) {
+        if (clients[i].pid == pid) return &clients[i];
+        if (slot == -1 && clients[i].pid == 0) slot = i;
+    }
+
+    if (slot == -1) {
+        slot = 0;
+        for (int i = 1; i < MAX_CLIENTS; ++i) {
+            const struct timespec* t = &clients[i].bucket.last_refill;
+            const struct timespec* oldest = &clients[slot].bucket.last_refill;
+            if (t->tv_sec < oldest->tv_sec || (t->tv_sec == oldest->tv_sec && t->tv_nsec < oldest->tv_nsec)) {
+                slot = i;
+            }
+        }
+    }
+
+    memset(&clients[slot], 0, sizeof(clients[slot]));
+    clients[slot].pid = pid;
+    bucket_init(&clients[slot].bucket, ADMISSION_BURST, WFQ_DEFAULT_WEIGHT);
+    return &clients[slot];
+}
+
+// Stato di ammissione (token bucket + WFQ) di un client
+struct client_bucket* get_client_bucket(pid_t pid) {
+    return &get_client_entry(pid)->bucket;
+}
+
 // Signal handler per cleanup
 void handle_sigint(int sig) {
     (void)sig;
     remove_message_queue(msgid);
     remove_shared_memory(shmid);
     semctl(semid, 0, IPC_RMID);
+    if (load) load->shards[shard_id].pid = 0;
+    if (load_shmid >= 0) remove_shared_memory(load_shmid);
     printf("\nRisorse IPC rimosse. Server terminato.\n");
     exit(0);
 }
 
-// Trova o crea uno stato di upload per un dato pid
-struct upload_state* get_upload_state(pid_t pid, unsigned int total_chunks) {
+// Signal handler del processo supervisore: termina gli shard e rimuove la tabella dei carichi
+void handle_sigint_supervisor(int sig) {
+    (void)sig;
+    for (int i = 0; i < num_shards; ++i) {
+        if (shard_pids[i] > 0) kill(shard_pids[i], SIGINT);
+    }
+    while (wait(NULL) > 0);
+    remove_shared_memory(load_shmid);
+    printf("\nShard terminati. Supervisore terminato.\n");
+    exit(0);
+}
+
+// Pubblica il carico dello shard nella tabella condivisa (letta dai client per il routing)
+void aggiorna_carico(void) {
+    if (!load) return;
+
+    unsigned int active = 0;
+    for (int i = 0; i < MAX_UPLOADS; ++i) {
+        if (uploads[i].pid != 0) active++;
+    }
+
+    struct shard_load* l = &load->shards[shard_id];
+    l->active_uploads = active;
+    l->pending = (unsigned int)pending_count;
+    l->queued_bytes = pending_bytes;
+}
+
+// Trova o crea lo stato di upload del client che ha inviato `req`.
+// Il file temporaneo è distinto per richiesta: in una verifica batch il client invia il file
+// successivo mentre il worker del precedente sta ancora leggendo il proprio
+struct upload_state* get_upload_state(const struct message* req) {
     for (int i = 0; i < MAX_UPLOADS; ++i) {
-        if (uploads[i].pid == pid)
+        if (uploads[i].pid == req->pid)
             return &uploads[i];
     }
 
     for (int i = 0; i < MAX_UPLOADS; ++i) {
         if (uploads[i].pid == 0) {
-            uploads[i].pid = pid;
-            snprintf(uploads[i].tmp_path, TMP_PATH_LEN, "/tmp/sha256_tmp_%d", pid);
+            uploads[i].pid = req->pid;
+            snprintf(uploads[i].tmp_path, TMP_PATH_LEN, "/tmp/sha256_tmp_%d_%u", req->pid, req->seq);
             uploads[i].received_chunks = 0;
-            uploads[i].total_chunks = total_chunks;
+            uploads[i].total_chunks = req->total_chunks;
+            uploads[i].received_bytes = 0;
+            uploads[i].node = -1;
+            uploads[i].data_node = -1;
+            uploads[i].cdc = 0;
+            uploads[i].zc_addr = NULL;
+            uploads[i].zc_worker = 0;
+            uploads[i].verify = 0;
+            uploads[i].batch = 0;
+            uploads[i].expected_manifest = NULL;
+            uploads[i].expected_count = 0;
+            uploads[i].expected_next = 0;
+            uploads[i].cdc_missing_count = 0;
+            uploads[i].cdc_missing_next = 0;
+            uploads[i].cdc_last = 0;
             return &uploads[i];
         }
     }
@@ -108,6 +258,19 @@ void clear_upload_state(pid_t pid) {
             uploads[i].tmp_path[0] = '\0';
             uploads[i].received_chunks = 0;
             uploads[i].total_chunks = 0;
+            uploads[i].received_bytes = 0;
+            uploads[i].node = -1;
+            uploads[i].data_node = -1;
+            uploads[i].cdc = 0;
+            if (uploads[i].zc_addr) detach_shared_memory(uploads[i].zc_addr);
+            uploads[i].zc_addr = NULL;
+            uploads[i].zc_worker = 0;
+            free(uploads[i].expected_manifest);
+            uploads[i].expected_manifest = NULL;
+            uploads[i].expected_count = 0;
+            uploads[i].expected_next = 0;
+            uploads[i].verify = 0;
+            uploads[i].batch = 0;
         }
     }
 }
@@ -120,41 +283,166 @@ void scrivi_e_chiudi(FILE *f, const void *buf, size_t size) {
 }
 
 // Funzione di utilità: scrive un chunk su file temporaneo usando la shm
-int scrivi_chunk_su_file(const struct message* req, const struct upload_state* up, int semid) {
+// Con affinity attiva le pagine del file temporaneo vengono allocate sul nodo del segmento client
+int scrivi_chunk_su_file(const struct message* req, struct upload_state* up, int semid) {
+    if (affinity_enabled) affinity_prefer_node(up->node);
     FILE *tmpf = (req->chunk_id == 0) ? fopen(up->tmp_path, "wb") : fopen(up->tmp_path, "ab");
 
     if (!tmpf) {
         perror("[SERVER] Errore apertura file temporaneo");
+        if (affinity_enabled) affinity_prefer_node(-1);
         return 0;
     }
 
+    TRACE(sem_mem_wait, req->pid, req->seq, req->chunk_id);
     sem_wait(semid, SEM_MEM);
+    TRACE(sem_mem_acquired, req->pid, req->seq, req->chunk_id);
     int client_shmid = create_shared_memory(req->shm_key, 65536);
     void *shmaddr = attach_shared_memory(client_shmid);
 
     if (!shmaddr) {
         fclose(tmpf);
         sem_signal(semid, SEM_MEM);
+        if (affinity_enabled) affinity_prefer_node(-1);
         return 0;
     }
 
+    // Il nodo dell'upload è quello in cui il client ha toccato per primo il proprio segmento
+    if (req->chunk_id == 0) {
+        up->node = affinity_node_of_address(shmaddr);
+        if (affinity_enabled) affinity_prefer_node(up->node);
+
+        // Le pagine del file temporaneo seguono la politica corrente: nodo del segmento con affinity
+        // attiva, altrimenti il nodo su cui gira il loop. È da lì che il worker leggerà
+        up->data_node = (affinity_enabled && up->node >= 0) ? up->node : affinity_current_node();
+    }
+
+    TRACE(tmp_write_begin, req->pid, req->seq, req->chunk_id);
     scrivi_e_chiudi(tmpf, shmaddr, req->filesize);
+    TRACE(tmp_write_end, req->pid, req->seq, req->chunk_id);
     detach_shared_memory(shmaddr);
     sem_signal(semid, SEM_MEM);
+    if (affinity_enabled) affinity_prefer_node(-1);
     return 1;
 }
 
-// Funzione di utilità: invia ack al client
-void invia_ack(const struct message* req, int msgid) {
+// Funzione di utilità: invia ack al client con l'eventuale segnale di backpressure.
+// `op` indica al client come proseguire (es. OP_CDC_DATA = il server chiede i dati del chunk)
+void invia_ack(const struct message* req, int msgid, unsigned int backoff_ms, int op) {
     struct message ack;
+    memset(&ack, 0, sizeof(ack));
     ack.mtype = req->pid;
     ack.pid = req->pid;
-    memset(ack.hash, 0, sizeof(ack.hash));
+    ack.backoff_ms = backoff_ms;
+    ack.op = op;
+    ack.chunk_id = req->chunk_id;
+    ack.seq = req->seq;
     send_message(msgid, &ack);
+    TRACE(ack_sent, req->pid, req->seq, req->chunk_id);
+}
+
+// Funzione di utilità: risponde a un ping del client (misura del round trip IPC).
+// Un ping rimasto in coda troppo a lungo non ha più un client in attesa: lo si scarta
+void rispondi_ping(const struct message* req) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    double now_us = ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+    if (now_us - (double)req->filesize > PING_TIMEOUT_US / 2) {
+        return;
+    }
+
+    struct message pong;
+    memset(&pong, 0, sizeof(pong));
+    pong.mtype = PING_REPLY_TYPE(req->pid);
+    pong.pid = req->pid;
+    pong.op = OP_PING;
+    send_message(msgid, &pong);
+}
+
+// Funzione di utilità: aggiunge i digest di un blocco di annunci al manifest dell'upload
+int aggiungi_a_manifest(const struct message* req, const struct upload_state* up,
+                        const struct cdc_record* records, unsigned int n) {
+    FILE *manifest = (req->chunk_id == 0) ? fopen(up->tmp_path, "w") : fopen(up->tmp_path, "a");
+
+    if (!manifest) {
+        perror("[SERVER] Errore apertura manifest");
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < n; ++i) {
+        fprintf(manifest, "%s\n", records[i].digest);
+    }
+    fclose(manifest);
+    return 1;
+}
+
+// Funzione di utilità: copia dalla shm del client i record di un annuncio CDC
+int leggi_annunci(const struct message* req, struct cdc_record* records) {
+    TRACE(sem_mem_wait, req->pid, req->seq, req->chunk_id);
+    sem_wait(semid, SEM_MEM);
+    TRACE(sem_mem_acquired, req->pid, req->seq, req->chunk_id);
+    int client_shmid = create_shared_memory(req->shm_key, 65536);
+    void *shmaddr = attach_shared_memory(client_shmid);
+
+    if (!shmaddr) {
+        sem_signal(semid, SEM_MEM);
+        return 0;
+    }
+
+    memcpy(records, shmaddr, req->filesize * sizeof(struct cdc_record));
+    detach_shared_memory(shmaddr);
+    sem_signal(semid, SEM_MEM);
+    return 1;
+}
+
+// Funzione di utilità: verifica i dati dei chunk mancanti nella shm del client e li salva nello store.
+// Il digest annunciato non è fidato: senza verifica un client potrebbe avvelenare lo store
+int salva_chunk_nello_store(const struct message* req, const struct upload_state* up) {
+    const struct cdc_record* missing = &up->cdc_missing[up->cdc_missing_next];
+    size_t total = 0;
+    for (unsigned int i = 0; i < req->total_chunks; ++i) {
+        total += missing[i].len;
+    }
+    if (total != req->filesize || total > CDC_MAX_CHUNK) return 0;
+
+    TRACE(sem_mem_wait, req->pid, req->seq, req->chunk_id);
+    sem_wait(semid, SEM_MEM);
+    TRACE(sem_mem_acquired, req->pid, req->seq, req->chunk_id);
+    int client_shmid = create_shared_memory(req->shm_key, 65536);
+    void *shmaddr = attach_shared_memory(client_shmid);
+
+    if (!shmaddr) {
+        sem_signal(semid, SEM_MEM);
+        return 0;
+    }
+
+    int ok = 1;
+    const unsigned char *data = shmaddr;
+    for (unsigned int i = 0; i < req->total_chunks && ok; ++i) {
+        char digest[65] = {0};
+        compute_sha256(data, missing[i].len, digest);
+        ok = strcmp(digest, missing[i].digest) == 0 &&
+             chunk_store_put(CHUNK_STORE_DIR, missing[i].digest, data, missing[i].len) == 0;
+        data += missing[i].len;
+    }
+    detach_shared_memory(shmaddr);
+    sem_signal(semid, SEM_MEM);
+    return ok;
+}
+
+// Funzione di utilità: calcola il backpressure per il client dopo aver servito un chunk
+unsigned int calcola_backoff(struct upload_state* up, size_t bytes) {
+    struct client_bucket* bucket = get_client_bucket(up->pid);
+    unsigned int backoff = bucket_consume(bucket, bytes, ADMISSION_RATE, ADMISSION_BURST);
+
+    if (bucket->inflight >= ADMISSION_MAX_INFLIGHT && backoff < ADMISSION_INFLIGHT_BACKOFF_MS) {
+        backoff = ADMISSION_INFLIGHT_BACKOFF_MS;
+    }
+    return backoff;
 }
 
 // Funzione di utilità: prepara una risposta SHA256 per il client
-struct message crea_risposta_hash(pid_t pid, size_t filesize, const char* hash) {
+struct message crea_risposta_hash(pid_t pid, unsigned int seq, size_t filesize, const char* hash) {
     struct message resp = {
         pid,           // mtype
         pid,           // pid
@@ -163,209 +451,740 @@ struct message crea_risposta_hash(pid_t pid, size_t filesize, const char* hash)
         0,             // chunk_id (non usato in risposta)
         0,             // total_chunks (non usato in risposta)
         0,             // last_chunk (non usato in risposta)
-        0              // shm_key (non usato in risposta)
+        0,             // shm_key (non usato in risposta)
+        0,             // backoff_ms (non usato in risposta)
+        OP_UPLOAD,     // op
+        seq            // seq
     };
 
     strncpy(resp.hash, hash, 65);
     return resp;
 }
 
-// ===================== MAIN SERVER =====================
+// Funzione di utilità: esito della verifica lato server. Se il digest coincide con l'atteso
+// la risposta porta solo l'esito: il client conosce già il digest
+void applica_verifica(struct message* resp, const struct upload_state* up) {
+    if (!up->verify) return;
 
-int main() {
-    // 1. Setup handler SIGINT per cleanup finale
-    printf("[SERVER] Avvio e inizializzazione risorse IPC...\n");
-    signal(SIGINT, handle_sigint);
+    if (strcmp(resp->hash, up->expected) == 0) {
+        resp->op = OP_VERIFY_OK;
+        memset(resp->hash, 0, sizeof(resp->hash));
+        stats_add(&stats->verify_ok, 1);
+    } else {
+        resp->op = OP_VERIFY_MISMATCH;
+        stats_add(&stats->verify_failed, 1);
+    }
+}
 
-    // 2. Inizializza coda messaggi (msgget)
-    msgid = create_message_queue(MSG_KEY);
+// Invia la risposta finale di un upload. In una verifica batch i file verificati non ricevono
+// risposta; i fallimenti viaggiano con il tipo VERIFY_REPLY_TYPE, separati dagli ack
+void invia_risposta(struct message* resp, const struct upload_state* up) {
+    if (up->batch) {
+        if (resp->op == OP_VERIFY_OK) return;
+        resp->mtype = VERIFY_REPLY_TYPE(resp->pid);
+    }
+    send_message(msgid, resp);
+}
 
-    // 3. Inizializza memoria condivisa (shmget)
-    shmid = create_shared_memory(SHM_KEY, 65536);
+// Chiude la verifica batch di un client quando tutti i file annunciati hanno un esito:
+// un solo messaggio di riepilogo con il numero di file OK e falliti
+void controlla_fine_batch(struct client_entry* client) {
+    if (client->batch_expected == 0 || client->batch_ok + client->batch_failed < client->batch_expected) {
+        return;
+    }
 
-    // 4. Inizializza semafori (semget + semctl)
-    semid = create_semaphore_set(SEM_KEY, 2); // 2 semafori: memoria e worker
-    semctl(semid, SEM_MEM, SETVAL, 1);
-    semctl(semid, SEM_PROC, SETVAL, max_workers);
-    memset(uploads, 0, sizeof(uploads));
-    printf("[SERVER] In ascolto di richieste client...\n");
+    struct message summary;
+    memset(&summary, 0, sizeof(summary));
+    summary.mtype = VERIFY_REPLY_TYPE(client->pid);
+    summary.pid = client->pid;
+    summary.op = OP_VERIFY_END;
+    summary.chunk_id = client->batch_ok;
+    summary.total_chunks = client->batch_failed;
+    summary.seq = client->batch_end_seq;
+    send_message(msgid, &summary);
 
-    // ===================== LOOP PRINCIPALE =====================
-    while (1) {
-        struct message req;
-        // ===================== SCHEDULAZIONE E SELEZIONE RICHIESTA =====================
-        // Se ci sono richieste pendenti, processa SEMPRE la più grande tra quelle pendenti e la richiesta corrente
-        int workers_free = semctl(semid, SEM_PROC, GETVAL);
-        if (pending_count > 0 && workers_free > 0) {
-            // Trova la richiesta più grande tra la coda e la nuova richiesta (se presente)
-            struct message *to_dispatch = NULL;
-            int max_idx = -1;
-            size_t max_size = 0;
-            for (int i = 0; i < pending_count; ++i) {
-                if (pending_queue[i].filesize > max_size) {
-                    max_size = pending_queue[i].filesize;
-                    max_idx = i;
-                }
-            }
+    client->batch_ok = 0;
+    client->batch_failed = 0;
+    client->batch_expected = 0;
+}
 
-            // Leggi la nuova richiesta
-            if (receive_message(msgid, 1, &req) != -1) {
-                if (req.mtype == 99) {
-                    // ===================== CONTROLLO: MODIFICA NUMERO WORKER =====================
-                    max_workers = (int)req.filesize;
-                    semctl(semid, SEM_PROC, SETVAL, max_workers);
-                    printf("[SERVER] Aggiornato max_workers a %d\n", max_workers);
-                    continue;
-                }
-
-                if (req.filesize > max_size) {
-                    // La nuova richiesta è la più grande
-                    to_dispatch = &req;
-                } else {
-                    // La più grande è nella coda
-                    to_dispatch = &pending_queue[max_idx].req;
-                    // Rimuovi dalla coda
-                    for (int j = max_idx + 1; j < pending_count; ++j) {
-                        pending_queue[j-1] = pending_queue[j];
-                    }
-                    pending_count--;
-                    // Accoda la nuova richiesta
-                    enqueue_pending(&req);
-                }
-            } else {
-                // Nessuna nuova richiesta, prendi la più grande dalla coda
-                to_dispatch = &pending_queue[max_idx].req;
-
-                for (int j = max_idx + 1; j < pending_count; ++j) {
-                    pending_queue[j-1] = pending_queue[j];
-                }
-                pending_count--;
-            }
+// Conta l'esito di un file di una verifica batch
+void registra_esito_batch(pid_t pid, int ok) {
+    struct client_entry* client = get_client_entry(pid);
+    if (ok) {
+        client->batch_ok++;
+    } else {
+        client->batch_failed++;
+    }
+    controlla_fine_batch(client);
+}
 
-            // ===================== DISPATCH DELLA RICHIESTA SELEZIONATA =====================
-            sem_wait(semid, SEM_PROC);
-            printf("[SERVER] Dispatch richiesta pendente (PID=%d, size=%zu)\n", to_dispatch->pid, to_dispatch->filesize);
-            struct upload_state* up = get_upload_state(to_dispatch->pid, to_dispatch->total_chunks);
-            if (!up) continue;
-
-            // Crea file temporaneo per il chunk
-            FILE *tmpf = (to_dispatch->chunk_id == 0) ? fopen(up->tmp_path, "wb") : fopen(up->tmp_path, "ab");
-            if (!tmpf) continue;
-
-            // ===================== SCRITTURA SU FILE TEMPORANEO (MUTUA ESCLUSIONE SHM) =====================
-            sem_wait(semid, SEM_MEM);
-            int client_shmid = create_shared_memory(to_dispatch->shm_key, 65536);
-            void *shmaddr = attach_shared_memory(client_shmid);
-
-            if (!shmaddr) {
-                fclose(tmpf);
-                sem_signal(semid, SEM_MEM);
-                continue;
-            }
+// Fine della verifica batch: il riepilogo parte appena l'ultimo worker ha comunicato l'esito
+void chiudi_batch(const struct message* req) {
+    struct client_entry* client = get_client_entry(req->pid);
+    client->batch_expected = (unsigned int)req->filesize;
+    client->batch_end_seq = req->seq;
+    controlla_fine_batch(client);
+}
 
-            scrivi_e_chiudi(tmpf, shmaddr, to_dispatch->filesize);
-            detach_shared_memory(shmaddr);
-            sem_signal(semid, SEM_MEM);
-            up->received_chunks++;
-
-            // ===================== INVIO ACK AL CLIENT =====================
-            struct message ack;
-            ack.mtype = to_dispatch->pid;
-            ack.pid = to_dispatch->pid;
-            memset(ack.hash, 0, sizeof(ack.hash));
-            send_message(msgid, &ack);
-
-            if (!to_dispatch->last_chunk) {
-                sem_signal(semid, SEM_PROC);
-                continue;
-            }
+// Registra se i byte dell'upload sono stati hashati sul nodo dei dati (file temporaneo o segmento
+// zero-copy) o attraversando i nodi
+void registra_traffico_numa(const struct upload_state* up) {
+    int worker_node = affinity_current_node();
+    if (up->data_node < 0 || worker_node < 0) {
+        stats_add(&stats->dispatch_unknown, 1);
+    } else if (worker_node == up->data_node) {
+        stats_add(&stats->dispatch_local, 1);
+        stats_add(&stats->bytes_local, up->received_bytes);
+    } else {
+        stats_add(&stats->dispatch_remote, 1);
+        stats_add(&stats->bytes_remote, up->received_bytes);
+    }
+}
+
+// Processo worker: fissa CPU e memoria sul nodo dei dati dell'upload.
+// Il buffer di lettura di compute_sha256_from_file è sullo stack del worker, quindi locale al nodo
+void prepara_worker(const struct upload_state* up, int cpu) {
+    if (cpu >= 0) {
+        affinity_pin_self(cpu);
+        affinity_prefer_node(up->data_node);
+    }
+}
 
-            // ===================== ULTIMO CHUNK: CALCOLO HASH E RISPOSTA =====================
-            pid_t pid = fork();
+// Fine di un upload nel worker: traffico tra nodi, risposta al client (in una verifica batch anche
+// l'esito al loop dello shard, che ne conserva il riepilogo) e statistiche
+void concludi_upload(const struct message* req, const struct upload_state* up, const char* hash) {
+    registra_traffico_numa(up);
 
-            if (pid == 0) {
-                // Processo figlio: calcola hash SHA256 e invia risposta al client
-                char hash[65] = {0};
-                compute_sha256_from_file(up->tmp_path, hash);
-                struct message resp = crea_risposta_hash(to_dispatch->pid, to_dispatch->filesize, hash);
-                send_message(msgid, &resp);
-                printf("\n[SERVER] Hash fornito al client PID=%d\n", to_dispatch->pid);
+    struct message resp = crea_risposta_hash(req->pid, req->seq, req->filesize, hash);
+    applica_verifica(&resp, up);
+    invia_risposta(&resp, up);
+    TRACE(resp_sent, req->pid, req->seq, req->chunk_id);
 
-                remove(up->tmp_path); // Elimina file temporaneo
-                sem_signal(semid, SEM_PROC); // Libera un worker
-                exit(0);
-            }
+    if (up->batch) {
+        struct message esito = {
+            1,
+            req->pid,
+            resp.op == OP_VERIFY_OK,    // filesize: 1 se il file è verificato
+            {0},
+            0,
+            0,
+            0,
+            0,
+            0,
+            OP_VERIFY_RESULT,
+            req->seq
+        };
+        send_message(msgid, &esito);
+    }
+    stats_add(&stats->uploads_completed, 1);
+    printf("\n[SERVER] Hash fornito al client PID=%d\n", req->pid);
+}
 
-            clear_upload_state(to_dispatch->pid);
-            while (waitpid(-1, NULL, WNOHANG) > 0)
-            continue;
+// Gestione messaggi di controllo (control client)
+void gestisci_controllo(const struct message* req) {
+    if (req->op == OP_CTRL_SET_WORKERS) {
+        max_workers = (int)req->filesize;
+        semctl(semid, SEM_PROC, SETVAL, max_workers);
+        stats->max_workers = max_workers;
+        printf("[SERVER] Aggiornato max_workers a %d\n", max_workers);
+        return;
+    }
+
+    if (req->op == OP_CTRL_SET_AFFINITY) {
+        char cpulist[HASH_SIZE];
+        strncpy(cpulist, req->hash, HASH_SIZE - 1);
+        cpulist[HASH_SIZE - 1] = '\0';
+
+        if (req->filesize && affinity_init(cpulist) <= 0) {
+            printf("[SERVER] Lista CPU non valida, affinity invariata\n");
+            return;
+        }
+        if (!req->filesize) affinity_init(NULL);
+
+        affinity_enabled = req->filesize ? 1 : 0;
+        stats->affinity_enabled = affinity_enabled;
+        stats->numa_nodes = affinity_node_count();
+        printf("[SERVER] Affinity %s (CPU: %s, nodi NUMA: %d)\n", affinity_enabled ? "attiva" : "disattivata",
+               cpulist[0] ? cpulist : "tutte", stats->numa_nodes);
+    }
+}
+
+// Raccoglie i worker terminati. Un worker zero-copy che esce prima dell'ultimo chunk (client
+// terminato a metà upload) lascia lo stato dell'upload nel loop: lo si libera qui
+void raccogli_worker(void) {
+    pid_t pid;
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+        for (int i = 0; i < MAX_UPLOADS; ++i) {
+            if (uploads[i].pid != 0 && uploads[i].zc_worker == pid) clear_upload_state(uploads[i].pid);
         }
+    }
+}
+
+// Riserva un worker (SEM_PROC) e avvia il processo, con la CPU scelta sul nodo dei dati dell'upload.
+// Ritorna come fork(): 0 nel figlio, -1 se il processo non parte (il worker viene restituito)
+pid_t avvia_worker(const struct message* req, const struct upload_state* up, int* cpu) {
+    TRACE(sem_proc_wait, req->pid, req->seq, req->chunk_id);
+    sem_wait(semid, SEM_PROC);
+    TRACE(sem_proc_acquired, req->pid, req->seq, req->chunk_id);
+    *cpu = affinity_enabled ? affinity_pick_cpu(up->data_node) : -1;
+    fflush(stdout); // evita che il figlio ristampi l'output bufferizzato del padre
+    pid_t pid = fork();
+
+    if (pid == -1) {
+        perror("[SERVER] fork worker fallita");
+        sem_signal(semid, SEM_PROC);
+    }
+    return pid;
+}
+
+// Ultimo chunk ricevuto: dispatch di un worker che calcola l'hash e risponde al client
+void dispatch_worker(const struct message* req, struct upload_state* up) {
+    int cpu;
+    pid_t pid = avvia_worker(req, up, &cpu);
 
-        // ===================== GESTIONE RICHIESTE SENZA PENDENZE =====================
-        if (receive_message(msgid, 1, &req) == -1) continue;
+    if (pid == 0) {
+        // Processo figlio: calcola hash SHA256 del file temporaneo (o dei chunk elencati nel manifest)
+        prepara_worker(up, cpu);
+        char hash[65] = {0};
+        TRACE(hash_begin, req->pid, req->seq, req->chunk_id);
+        if (up->cdc) {
+            compute_sha256_from_manifest(CHUNK_STORE_DIR, up->tmp_path, hash);
+        } else {
+            compute_sha256_from_file(up->tmp_path, hash);
+        }
+        TRACE(hash_end, req->pid, req->seq, req->chunk_id);
 
-        // Stampa solo se cambia PID o chunk, ma stampa SOLO l'inizio e la fine upload
-        if (req.chunk_id == 0) {
-            printf("[SERVER] Inizio upload da client PID=%d, size=%zu, chunk %u/%u\n",
-                   req.pid, req.filesize * req.total_chunks, req.chunk_id+1, req.total_chunks);
+        // Il file temporaneo va liberato prima della risposta: lo stesso client può avviare subito
+        // un altro upload sullo stesso percorso. Il manifest di un upload CDC resta invece nello
+        // store, per le verifiche chunk per chunk
+        if (!up->cdc || chunk_store_save_manifest(CHUNK_STORE_DIR, hash, up->tmp_path) == -1) {
+            remove(up->tmp_path);
         }
+
+        concludi_upload(req, up, hash);
+        sem_signal(semid, SEM_PROC); // Libera un worker
+        exit(0);
+    }
+
+    clear_upload_state(req->pid);
+
+    // Rimuovi figli zombie
+    raccogli_worker();
+}
+
+// Serve un chunk classico: copia su file temporaneo, ack con backpressure e, se ultimo, dispatch del worker
+void servi_chunk(const struct message* req, struct upload_state* up) {
+    if (!scrivi_chunk_su_file(req, up, semid)) {
+        return;
+    }
+
+    up->received_chunks++;
+    up->received_bytes += req->filesize;
+    stats_add(&stats->bytes_received, req->filesize);
+    invia_ack(req, msgid, calcola_backoff(up, req->filesize), OP_UPLOAD);
+    if (!req->last_chunk) {
+        return;
+    }
+
+    dispatch_worker(req, up);
+}
+
+// Confronta un digest annunciato con il chunk successivo del manifest atteso;
+// sull'ultimo chunk del file controlla anche che il manifest atteso sia finito
+int chunk_atteso(struct upload_state* up, const char* digest, int ultimo) {
+    if (up->expected_next == up->expected_count) return 0;
+
+    const char* atteso = up->expected_manifest + up->expected_next * MANIFEST_DIGEST_LEN;
+    if (strcmp(atteso, digest) != 0) return 0;
+    up->expected_next++;
+
+    return !ultimo || up->expected_next == up->expected_count;
+}
+
+// 1 se il chunk è già tra quelli mancanti chiesti al client nell'annuncio corrente
+int chunk_gia_richiesto(const struct upload_state* up, const char* digest) {
+    for (unsigned int i = 0; i < up->cdc_missing_count; ++i) {
+        if (strcmp(up->cdc_missing[i].digest, digest) == 0) return 1;
+    }
+    return 0;
+}
+
+// Funzione di utilità: annulla un upload CDC con l'ack `op` (rifiuto o verifica fallita).
+// In una verifica batch il fallimento viene anche riportato come quelli calcolati dai worker
+void annulla_upload_cdc(const struct message* req, struct upload_state* up, int op) {
+    invia_ack(req, msgid, 0, op);
+    if (up->batch && op == OP_VERIFY_MISMATCH) {
+        struct message resp = crea_risposta_hash(req->pid, req->seq, 0, "");
+        resp.op = OP_VERIFY_MISMATCH;
+        invia_risposta(&resp, up);
+        registra_esito_batch(req->pid, 0);
+    }
+    remove(up->tmp_path);
+    clear_upload_state(req->pid);
+}
+
+// Serve un annuncio CDC: un blocco di digest letto dalla shm del client. Un solo ack risponde
+// all'intero blocco con la bitmap dei chunk che mancano nello store
+void servi_annuncio_cdc(const struct message* req, struct upload_state* up) {
+    struct cdc_record records[CDC_BATCH];
+    unsigned int n = (unsigned int)req->filesize;
+
+    if (n == 0 || n > CDC_BATCH || up->cdc_missing_next < up->cdc_missing_count || !leggi_annunci(req, records)) {
+        printf("[SERVER] Annuncio CDC non valido da PID=%d\n", req->pid);
+        annulla_upload_cdc(req, up, OP_CDC_REJECT);
+        return;
+    }
+
+    struct message ack;
+    memset(&ack, 0, sizeof(ack));
+    up->cdc_missing_count = 0;
+    up->cdc_missing_next = 0;
+    up->cdc_last = req->last_chunk;
+
+    for (unsigned int i = 0; i < n; ++i) {
+        struct cdc_record* r = &records[i];
+        r->digest[HASH_SIZE - 1] = '\0';
+        if (r->len > CDC_MAX_CHUNK || !sha256_hex_valid(r->digest)) {
+            printf("[SERVER] Chunk CDC non valido da PID=%d\n", req->pid);
+            annulla_upload_cdc(req, up, OP_CDC_REJECT);
+            return;
+        }
+
+        // Verifica chunk per chunk: il primo digest diverso dal manifest atteso chiude subito l'upload,
+        // senza trasferire dati né occupare un worker
+        if (up->expected_manifest && !chunk_atteso(up, r->digest, req->last_chunk && i == n - 1)) {
+            printf("[SERVER] Verifica fallita al chunk %u (PID=%d)\n", req->chunk_id + i, req->pid);
+            stats_add(&stats->verify_failed, 1);
+            stats_add(&stats->verify_early_abort, 1);
+            annulla_upload_cdc(req, up, OP_VERIFY_MISMATCH);
+            return;
+        }
+
+        // Chunk mai visto: il client dovrà copiarlo nella shm. Un chunk nuovo che si ripete nello
+        // stesso annuncio si chiede una volta sola: al salvataggio della prima copia sarà nello store
+        if (!chunk_store_has(CHUNK_STORE_DIR, r->digest) && !chunk_gia_richiesto(up, r->digest)) {
+            ack.hash[i / 8] |= (char)(1 << (i % 8));
+            up->cdc_missing[up->cdc_missing_count++] = *r;
+        } else {
+            stats_add(&stats->bytes_deduplicated, r->len);
+        }
+        up->received_bytes += r->len;
+    }
+
+    if (!aggiungi_a_manifest(req, up, records, n)) {
+        annulla_upload_cdc(req, up, OP_CDC_REJECT);
+        return;
+    }
+    up->received_chunks += n;
+
+    ack.mtype = req->pid;
+    ack.pid = req->pid;
+    ack.chunk_id = req->chunk_id;
+    ack.seq = req->seq;
+    ack.filesize = up->cdc_missing_count;
+    ack.backoff_ms = calcola_backoff(up, 0);
+    ack.op = up->cdc_missing_count ? OP_CDC_DATA : OP_UPLOAD;
+    send_message(msgid, &ack);
+    TRACE(ack_sent, req->pid, req->seq, req->chunk_id);
+
+    if (req->last_chunk && up->cdc_missing_count == 0) {
+        dispatch_worker(req, up);
+    }
+}
+
+// Serve i dati CDC: uno o più chunk mancanti, consecutivi nella shm del client
+void servi_dati_cdc(const struct message* req, struct upload_state* up) {
+    unsigned int remaining = up->cdc_missing_count - up->cdc_missing_next;
+
+    if (req->total_chunks == 0 || req->total_chunks > remaining || !salva_chunk_nello_store(req, up)) {
+        printf("[SERVER] Dati dei chunk non corrispondenti all'annuncio (PID=%d)\n", req->pid);
+        annulla_upload_cdc(req, up, OP_CDC_REJECT);
+        return;
+    }
+
+    up->cdc_missing_next += req->total_chunks;
+    stats_add(&stats->bytes_received, req->filesize);
+    invia_ack(req, msgid, calcola_backoff(up, req->filesize), OP_UPLOAD);
+
+    if (req->last_chunk && up->cdc_last && up->cdc_missing_next == up->cdc_missing_count) {
+        dispatch_worker(req, up);
+    }
+}
+
+// Serve un messaggio CDC: annuncio di un blocco di digest oppure i dati richiesti dal server
+void servi_chunk_cdc(const struct message* req, struct upload_state* up) {
+    up->cdc = 1;
+    // I chunk nuovi vengono scritti nello store dal loop, senza politica di memoria dedicata
+    if (up->data_node < 0) up->data_node = affinity_current_node();
+
+    if (req->op == OP_CDC_ANNOUNCE) {
+        servi_annuncio_cdc(req, up);
+    } else {
+        servi_dati_cdc(req, up);
+    }
+}
+
+// Collega il segmento multi-slot del client, solo se contiene davvero ZC_SLOTS slot:
+// gli offset degli slot vengono dal client e un segmento più piccolo porterebbe a leggere fuori mappa
+void* collega_segmento_zerocopy(key_t shm_key) {
+    struct shmid_ds ds;
+    int client_shmid = shmget(shm_key, 0, 0);
+
+    if (client_shmid == -1 || shmctl(client_shmid, IPC_STAT, &ds) == -1 ||
+        ds.shm_segsz < (size_t)ZC_SLOTS * ZC_SLOT_SIZE) {
+        return NULL;
+    }
+    return attach_shared_memory(client_shmid);
+}
+
+// SIGALRM nel worker zero-copy: interrompe soltanto l'attesa del prossimo chunk
+void sveglia_worker(int sig) {
+    (void)sig;
+}
+
+// Attende il prossimo chunk inoltrato dal loop. Ogni ZC_WORKER_IDLE_S secondi senza chunk si controlla
+// che il client esista ancora: se è terminato a metà upload il worker libera il proprio posto.
+// Ritorna 0 se il client non c'è più
+int attendi_chunk_zerocopy(pid_t client, struct message* req) {
+    while (1) {
+        alarm(ZC_WORKER_IDLE_S);
+        int ret = receive_message(msgid, ZC_WORKER_TYPE(client), req);
+        alarm(0);
+        if (ret == 0) return 1;
+        if (errno != EINTR || (kill(client, 0) == -1 && errno == ESRCH)) return 0;
+    }
+}
+
+// Worker di un upload zero-copy: riceve dal loop i chunk dell'upload, aggiorna l'hash leggendo lo slot
+// del segmento client in place (nessuna copia, nessun file temporaneo) e solo dopo invia l'ack che
+// restituisce lo slot al client, che nel frattempo riempie gli altri slot. Gli upload zero-copy hashano
+// così in parallelo, su worker distinti, come quelli classici
+void esegui_worker_zerocopy(struct upload_state* up, int cpu) {
+    prepara_worker(up, cpu);
+    signal(SIGALRM, sveglia_worker);
+
+    struct sha256_stream sha;
+    sha256_stream_init(&sha);
+    struct message req;
+    while (attendi_chunk_zerocopy(up->pid, &req)) {
+        // Upload annullato dal loop (chunk non valido): il rifiuto è già stato inviato al client
+        if (req.op == OP_ZC_REJECT) break;
+
+        const unsigned char *slot = (const unsigned char *)up->zc_addr + (req.chunk_id % ZC_SLOTS) * ZC_SLOT_SIZE;
+        TRACE(hash_begin, req.pid, req.seq, req.chunk_id);
+        sha256_stream_update(&sha, slot, req.filesize);
+        TRACE(hash_end, req.pid, req.seq, req.chunk_id);
+        up->received_bytes += req.filesize;
+        invia_ack(&req, msgid, req.backoff_ms, OP_UPLOAD);
+
         if (req.last_chunk) {
-            printf("[SERVER] Fine upload da client PID=%d, size=%zu, chunk %u/%u\n",
-                   req.pid, req.filesize * req.total_chunks, req.chunk_id+1, req.total_chunks);
+            char hash[65] = {0};
+            sha256_stream_final(&sha, hash);
+            concludi_upload(&req, up, hash);
+            break;
         }
+    }
 
-        // Gestione messaggio di controllo
-        if (req.mtype == 99) { // CONTROL_TYPE
-            max_workers = (int)req.filesize;
-            semctl(semid, SEM_PROC, SETVAL, max_workers);
-            printf("[SERVER] Aggiornato max_workers a %d\n", max_workers);
-            continue;
+    detach_shared_memory(up->zc_addr);
+    sem_signal(semid, SEM_PROC); // Libera un worker
+    exit(0);
+}
+
+// Serve un chunk zero-copy. Al primo chunk si collega il segmento del client e si avvia il worker
+// dell'upload, che eredita il collegamento; poi il loop si limita a inoltrargli i chunk (primo
+// compreso) con il backpressure calcolato dall'ammissione. L'ack parte dal worker, dopo l'hash
+void servi_chunk_zerocopy(const struct message* req, struct upload_state* up) {
+    if (req->chunk_id == 0 && !up->zc_worker && req->filesize <= ZC_SLOT_SIZE) {
+        up->zc_addr = collega_segmento_zerocopy(req->shm_key);
+        if (up->zc_addr) {
+            up->node = affinity_node_of_address(up->zc_addr);
+            up->data_node = up->node;   // l'hash legge direttamente il segmento
+
+            int cpu;
+            pid_t pid = avvia_worker(req, up, &cpu);
+            if (pid == 0) esegui_worker_zerocopy(up, cpu);
+            if (pid > 0) up->zc_worker = pid;
+
+            // Il loop non legge il segmento: il collegamento resta solo al worker
+            detach_shared_memory(up->zc_addr);
+            up->zc_addr = NULL;
         }
+    }
+
+    if (!up->zc_worker || req->filesize > ZC_SLOT_SIZE) {
+        printf("[SERVER] Chunk zero-copy non valido da PID=%d\n", req->pid);
+        invia_ack(req, msgid, 0, OP_ZC_REJECT);
+        if (up->zc_worker) {
+            struct message abort = *req;
+            abort.mtype = ZC_WORKER_TYPE(req->pid);
+            abort.op = OP_ZC_REJECT;
+            send_message(msgid, &abort);
+        }
+        clear_upload_state(req->pid);
+        return;
+    }
+
+    struct message fwd = *req;
+    fwd.mtype = ZC_WORKER_TYPE(req->pid);
+    fwd.backoff_ms = calcola_backoff(up, req->filesize);
+    send_message(msgid, &fwd);
+    up->received_chunks++;
+    stats_add(&stats->bytes_received, req->filesize);
+
+    // Dopo l'ultimo chunk l'upload prosegue solo nel worker
+    if (req->last_chunk) {
+        clear_upload_state(req->pid);
+    }
+}
 
-        // Se non ci sono worker disponibili, accoda la richiesta
-        if (semctl(semid, SEM_PROC, GETVAL) == 0) {
-            enqueue_pending(&req);
+// Apertura di una verifica: il digest atteso arriva prima dei chunk
+void inizia_verifica(const struct message* req, struct upload_state* up) {
+    up->verify = 1;
+    up->batch = req->total_chunks == 1;
+    strncpy(up->expected, req->hash, HASH_SIZE - 1);
+    up->expected[HASH_SIZE - 1] = '\0';
+
+    // Se un upload CDC precedente ha prodotto il file atteso se ne conosce l'elenco dei chunk
+    free(up->expected_manifest);
+    up->expected_next = 0;
+    up->expected_manifest = chunk_store_load_manifest(CHUNK_STORE_DIR, up->expected, &up->expected_count);
+
+    invia_ack(req, msgid, 0, OP_UPLOAD);
+}
+
+// Serve una richiesta di upload in base al protocollo indicato dal client
+void servi_richiesta(const struct message* req, struct upload_state* up) {
+    if (req->op == OP_VERIFY_BEGIN) {
+        inizia_verifica(req, up);
+    } else if (req->op == OP_CDC_ANNOUNCE || req->op == OP_CDC_DATA) {
+        servi_chunk_cdc(req, up);
+    } else if (req->op == OP_ZEROCOPY) {
+        servi_chunk_zerocopy(req, up);
+    } else {
+        servi_chunk(req, up);
+    }
+}
+
+// Richieste che occupano un worker: l'ultimo chunk di un upload avvia il calcolo dell'hash.
+// Un annuncio CDC finale può ancora chiedere i dati dei chunk mancanti: lo si tratta comunque come finale.
+// Uno zero-copy occupa il worker dal primo chunk, che lo avvia, fino alla fine dell'upload
+int richiede_worker(const struct message* req) {
+    if (req->op == OP_ZEROCOPY) return req->chunk_id == 0;
+    return req->last_chunk;
+}
+
+// Accetta un messaggio appena ricevuto: controllo e ping subito, upload in coda con il proprio tag WFQ
+void accetta_richiesta(struct message* req) {
+    TRACE(msg_recv, req->pid, req->seq, req->chunk_id);
+
+    // Gestione messaggio di controllo
+    if (req->op >= OP_CTRL_SET_WORKERS) {
+        gestisci_controllo(req);
+        return;
+    }
+
+    // Ping di calibrazione: risposta immediata, fuori da ammissione e coda pendente
+    if (req->op == OP_PING) {
+        rispondi_ping(req);
+        return;
+    }
+
+    // Verifica batch: esiti dei worker e chiusura del batch non trasportano dati
+    if (req->op == OP_VERIFY_RESULT) {
+        registra_esito_batch(req->pid, req->filesize == 1);
+        return;
+    }
+    if (req->op == OP_VERIFY_END) {
+        chiudi_batch(req);
+        return;
+    }
+
+    // Stampa solo se cambia PID o chunk, ma stampa SOLO l'inizio e la fine upload
+    if (req->chunk_id == 0 && req->op != OP_VERIFY_BEGIN) {
+        printf("[SERVER] Inizio upload da client PID=%d, size=%zu, chunk %u/%u\n",
+               req->pid, req->filesize * req->total_chunks, req->chunk_id+1, req->total_chunks);
+    }
+    if (req->last_chunk) {
+        printf("[SERVER] Fine upload da client PID=%d, size=%zu, chunk %u/%u\n",
+               req->pid, req->filesize * req->total_chunks, req->chunk_id+1, req->total_chunks);
+    }
+
+    // ===================== AMMISSIONE: TAG WFQ E CODA PENDENTE =====================
+    struct client_bucket* bucket = get_client_bucket(req->pid);
+    double start_tag;
+    // Annunci e aperture di verifica non trasferiscono dati
+    size_t bytes = (req->op == OP_CDC_ANNOUNCE || req->op == OP_VERIFY_BEGIN) ? 0 : req->filesize;
+    double finish_tag = wfq_tag(bucket, wfq_vtime, bytes, &start_tag);
+
+    enqueue_pending(req, start_tag, finish_tag);
+    TRACE(pending_enqueue, req->pid, req->seq, req->chunk_id);
+    bucket->inflight++;
+}
+
+// Serve le richieste pendenti in ordine di tag di fine. Quelle che richiedono un worker restano
+// in coda finché non se ne libera uno, e con loro le richieste successive dello stesso client
+// (ordine FIFO per client). Ritorna il numero di richieste servite
+int servi_pendenti(void) {
+    int servite = 0;
+    int liberi = semctl(semid, SEM_PROC, GETVAL);
+    pid_t bloccati[PENDING_QUEUE_SIZE];
+    int num_bloccati = 0;
+
+    for (int i = 0; i < pending_count; ) {
+        const struct message* next = &pending_queue[i].req;
+        int bloccato = 0;
+        for (int b = 0; b < num_bloccati && !bloccato; ++b) {
+            bloccato = (bloccati[b] == next->pid);
+        }
+        if (bloccato || (richiede_worker(next) && liberi <= 0)) {
+            if (!bloccato) bloccati[num_bloccati++] = next->pid;
+
+            // L'attesa di un worker libero è attribuita alla richiesta dal primo passaggio senza worker
+            if (!bloccato && !pending_queue[i].waiting_worker) {
+                TRACE(sem_proc_wait, next->pid, next->seq, next->chunk_id);
+                pending_queue[i].waiting_worker = 1;
+            }
+            i++;
             continue;
         }
 
-        struct upload_state* up = get_upload_state(req.pid, req.total_chunks);
+        struct message req;
+        int waited = pending_queue[i].waiting_worker;
+        dequeue_pending(i, &req);
+        TRACE(pending_dequeue, req.pid, req.seq, req.chunk_id);
+        if (waited) TRACE(sem_proc_acquired, req.pid, req.seq, req.chunk_id);
+        struct client_bucket* bucket = get_client_bucket(req.pid);
+        if (bucket->inflight > 0) bucket->inflight--;
+        if (richiede_worker(&req)) liberi--;
+
+        struct upload_state* up = get_upload_state(&req);
         if (!up) {
             printf("[SERVER] ERRORE: troppi upload simultanei!\n");
             continue;
         }
+        servi_richiesta(&req, up);
+        servite++;
+    }
+    return servite;
+}
 
-        if (!scrivi_chunk_su_file(&req, up, semid)) {
-            continue;
+// ===================== LOOP DI UNO SHARD =====================
+
+// Loop di uno shard: ogni shard ha coda, semafori e segmento propri nel namespace
+void esegui_shard(void) {
+    struct ipc_keys keys = ipc_keys_for(ipc_ns, shard_id);
+
+    // 1. Setup handler SIGINT per cleanup finale
+    printf("[SERVER] Avvio shard %d/%d (namespace %d) e inizializzazione risorse IPC...\n",
+           shard_id, num_shards, ipc_ns);
+    signal(SIGINT, handle_sigint);
+    signal(SIGTERM, handle_sigint);     // anche `kill` e `timeout`: rimozione risorse e dump del tracing
+    TRACE_DUMP_ON_SIGNAL(SIGUSR1);      // tracing: `kill -USR1 <pid_shard>` scrive il dump senza fermare lo shard
+
+    // 2. Inizializza coda messaggi (msgget)
+    msgid = create_message_queue(keys.msg_key);
+
+    // 3. Inizializza memoria condivisa (shmget)
+    shmid = create_shared_memory(keys.shm_key, 65536);
+    stats = attach_shared_memory(shmid);
+    if (!stats) exit(EXIT_FAILURE);
+
+    // 4. Inizializza semafori (semget + semctl)
+    semid = create_semaphore_set(keys.sem_key, 2); // 2 semafori: memoria e worker
+    semctl(semid, SEM_MEM, SETVAL, 1);
+    semctl(semid, SEM_PROC, SETVAL, max_workers);
+    memset(uploads, 0, sizeof(uploads));
+    memset(clients, 0, sizeof(clients));
+
+    // 5. Topologia CPU/NUMA e statistiche iniziali
+    affinity_init(NULL);
+    memset(stats, 0, sizeof(*stats));
+    stats->max_workers = max_workers;
+    stats->numa_nodes = affinity_node_count();
+
+    // 6. Store dei chunk per la deduplicazione (upload content-defined)
+    chunk_store_init(CHUNK_STORE_DIR);
+    if (load) load->shards[shard_id].pid = getpid();
+    printf("[SERVER] In ascolto di richieste client...\n");
+
+    // ===================== LOOP PRINCIPALE =====================
+    // Il loop non si blocca mai su SEM_PROC: solo le richieste che avviano un worker aspettano
+    // in coda, mentre chunk intermedi, annunci, messaggi di controllo e ping vengono serviti subito
+    while (1) {
+        aggiorna_carico();
+        raccogli_worker();
+
+        // Preleva senza bloccare tutto ciò che è arrivato, poi servi in ordine WFQ
+        struct message req;
+        int ricevute = 0;
+        while (pending_count < PENDING_QUEUE_SIZE && receive_message_nowait(msgid, 1, &req) == 0) {
+            accetta_richiesta(&req);
+            ricevute++;
         }
+        if (servi_pendenti() > 0 || ricevute > 0) continue;
 
-        up->received_chunks++;
-        invia_ack(&req, msgid);
-        if (!req.last_chunk) {
+        if (pending_count == 0) {
+            // Nessun lavoro: attesa bloccante del prossimo messaggio
+            if (receive_message(msgid, 1, &req) == 0) accetta_richiesta(&req);
+        } else {
+            // Solo richieste in attesa di un worker: attesa breve, poi si torna a leggere la coda
+            if (sem_wait_timeout(semid, SEM_PROC, WORKER_POLL_MS) == 0) sem_signal(semid, SEM_PROC);
+        }
+    }
+    // 7. Cleanup finale non necessario.
+    // Il ciclo while è infinito e gestisce SIGINT per rimuovere risorse IPC.
+}
+
+// ===================== MAIN SERVER =====================
+
+int main(int argc, char *argv[]) {
+    // ===================== PARSING ARGOMENTI =====================
+    ipc_ns = ipc_default_namespace();
+    int pin_shards = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:p")) != -1) {
+        if (opt == 'n' && (ipc_ns = ipc_parse_namespace(optarg)) >= 0) continue;
+        if (opt == 's' && (num_shards = atoi(optarg)) >= 1 && num_shards <= MAX_SHARDS) continue;
+        if (opt == 'p') {
+            pin_shards = 1;     // ogni shard sulle CPU di un nodo NUMA (round robin sui nodi)
             continue;
         }
+        fprintf(stderr, "Uso: %s [-n namespace] [-s shard (1-%d)] [-p]\n", argv[0], MAX_SHARDS);
+        exit(EXIT_FAILURE);
+    }
 
-        // Ultimo chunk: dispatch worker per hash
-        sem_wait(semid, SEM_PROC);
-        pid_t pid = fork();
+    // ===================== TABELLA DEI CARICHI DEL NAMESPACE =====================
+    load = create_load_table(ipc_ns, &load_shmid);
+    if (!load) exit(EXIT_FAILURE);
+    memset(load, 0, sizeof(*load));
+    load->nshards = num_shards;
 
-        if (pid == 0) {
-            // Processo figlio: calcola hash SHA256 del file temporaneo
-            char hash[65] = {0};
-            compute_sha256_from_file(up->tmp_path, hash);
-            struct message resp = crea_risposta_hash(req.pid, req.filesize, hash);
-            send_message(msgid, &resp);
-            printf("\n[SERVER] Hash fornito al client PID=%d\n", req.pid);
+    if (num_shards == 1) {
+        esegui_shard();
+    }
 
-            remove(up->tmp_path); // Elimina file temporaneo dopo l'invio della risposta
-            sem_signal(semid, SEM_PROC); // Libera un worker
-            exit(0);
-        }
+    // ===================== AVVIO SHARD =====================
+    // Il supervisore non serve richieste: avvia gli shard e attende SIGINT per terminarli
+    affinity_init(NULL);
+    signal(SIGINT, handle_sigint_supervisor);
+    signal(SIGTERM, handle_sigint_supervisor);
+    for (int i = 0; i < num_shards; ++i) {
+        fflush(stdout);
+        pid_t pid = fork();
 
-        clear_upload_state(req.pid);
+        if (pid == -1) {
+            perror("[SERVER] fork shard fallita");
+        } else if (pid == 0) {
+            shard_id = i;
+            load_shmid = -1;    // la tabella resta del supervisore
+            if (pin_shards) affinity_bind_to_node_index(i);
+            esegui_shard();
+        }
+        shard_pids[i] = pid;
+    }
 
-        // Rimuovi figli zombie
-        while (waitpid(-1, NULL, WNOHANG) > 0);
+    while (1) {
+        pause();
     }
-    // 6. Cleanup finale non necessario.
-    // Il ciclo while è infinito e gestisce SIGINT per rimuovere risorse IPC.
 }
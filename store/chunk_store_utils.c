@@ -0,0 +1,161 @@
+#include "chunk_store_utils.h"
+#include "sha256_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// ---- PERCORSO DI UN CHUNK ----
+static void chunk_path(const char* dir, const char* digest, char* out) {
+    snprintf(out, CHUNK_PATH_LEN, "%s/%s", dir, digest);
+}
+
+// ---- PERCORSO DI UN MANIFEST ----
+static void manifest_path_for(const char* dir, const char* file_digest, char* out) {
+    snprintf(out, CHUNK_PATH_LEN, "%s/manifests/%s", dir, file_digest);
+}
+
+// ---- CREAZIONE DIRECTORY ----
+int chunk_store_init(const char* dir) {
+    char manifests[CHUNK_PATH_LEN];
+    snprintf(manifests, CHUNK_PATH_LEN, "%s/manifests", dir);
+
+    if ((mkdir(dir, 0700) == -1 && errno != EEXIST) || (mkdir(manifests, 0700) == -1 && errno != EEXIST)) {
+        perror("mkdir chunk store failed");
+        return -1;
+    }
+    return 0;
+}
+
+// ---- PRESENZA CHUNK ----
+int chunk_store_has(const char* dir, const char* digest) {
+    char path[CHUNK_PATH_LEN];
+    chunk_path(dir, digest, path);
+    return access(path, R_OK) == 0;
+}
+
+// ---- SALVATAGGIO CHUNK ----
+int chunk_store_put(const char* dir, const char* digest, const void* data, size_t len) {
+    char path[CHUNK_PATH_LEN];
+    char tmp_path[CHUNK_PATH_LEN];
+    chunk_path(dir, digest, path);
+    snprintf(tmp_path, CHUNK_PATH_LEN, "%s/.%s.%d", dir, digest, getpid());
+
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f) {
+        perror("[STORE] Errore apertura chunk");
+        return -1;
+    }
+    if (fwrite(data, 1, len, f) != len || fclose(f) != 0) {
+        perror("[STORE] Errore scrittura chunk");
+        remove(tmp_path);
+        return -1;
+    }
+    if (rename(tmp_path, path) == -1) {
+        perror("[STORE] Errore rename chunk");
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// ---- SHA256 RICOMPOSTO DAI CHUNK ----
+void compute_sha256_from_manifest(const char* dir, const char* manifest_path, char* output_hash) {
+    FILE* manifest = fopen(manifest_path, "r");
+    if (!manifest) {
+        printf("Errore apertura manifest per SHA256: %s\n", manifest_path);
+        output_hash[0] = '\0';
+        return;
+    }
+
+    struct sha256_stream sha;
+    if (!sha256_stream_init(&sha)) {
+        fclose(manifest);
+        output_hash[0] = '\0';
+        return;
+    }
+
+    // ---- LETTURA CHUNK IN ORDINE E AGGIORNAMENTO SHA256 ----
+    char digest[80];
+    unsigned char buf[65536];
+    while (fgets(digest, sizeof(digest), manifest)) {
+        digest[strcspn(digest, "\n")] = '\0';
+
+        char path[CHUNK_PATH_LEN];
+        chunk_path(dir, digest, path);
+        FILE* chunk = sha256_hex_valid(digest) ? fopen(path, "rb") : NULL;
+        if (!chunk) {
+            printf("Chunk mancante nello store: %s\n", digest);
+            fclose(manifest);
+            output_hash[0] = '\0';
+            return;
+        }
+
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), chunk)) > 0) {
+            sha256_stream_update(&sha, buf, n);
+        }
+        fclose(chunk);
+    }
+    fclose(manifest);
+
+    sha256_stream_final(&sha, output_hash);
+}
+
+// ---- CONSERVAZIONE MANIFEST ----
+int chunk_store_save_manifest(const char* dir, const char* file_digest, const char* manifest_path) {
+    if (!sha256_hex_valid(file_digest)) return -1;
+
+    char path[CHUNK_PATH_LEN];
+    manifest_path_for(dir, file_digest, path);
+    if (rename(manifest_path, path) == -1) {
+        perror("[STORE] Errore salvataggio manifest");
+        return -1;
+    }
+    return 0;
+}
+
+// ---- CARICAMENTO MANIFEST CONSERVATO ----
+// Lo stream viene chiuso prima di ritornare: il server forka worker durante la verifica e un FILE*
+// aperto nel padre condividerebbe l'offset con i figli, che all'uscita lo riposizionano
+char* chunk_store_load_manifest(const char* dir, const char* file_digest, size_t* count) {
+    if (!sha256_hex_valid(file_digest)) return NULL;
+
+    char path[CHUNK_PATH_LEN];
+    manifest_path_for(dir, file_digest, path);
+    FILE* manifest = fopen(path, "r");
+    if (!manifest) return NULL;
+
+    // Ogni riga occupa almeno MANIFEST_DIGEST_LEN byte (digest e newline)
+    struct stat st;
+    if (fstat(fileno(manifest), &st) == -1) {
+        fclose(manifest);
+        return NULL;
+    }
+    size_t max_lines = (size_t)st.st_size / MANIFEST_DIGEST_LEN + 1;
+    char* digests = malloc(max_lines * MANIFEST_DIGEST_LEN);
+    if (!digests) {
+        perror("[STORE] malloc manifest");
+        fclose(manifest);
+        return NULL;
+    }
+
+    char line[80];
+    size_t n = 0;
+    while (n < max_lines && fgets(line, sizeof(line), manifest)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (!sha256_hex_valid(line)) {
+            free(digests);
+            fclose(manifest);
+            return NULL;
+        }
+        memcpy(digests + n * MANIFEST_DIGEST_LEN, line, MANIFEST_DIGEST_LEN);
+        n++;
+    }
+    fclose(manifest);
+
+    *count = n;
+    return digests;
+}
@@ -0,0 +1,33 @@
+#ifndef CHUNK_STORE_UTILS_H
+#define CHUNK_STORE_UTILS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define CHUNK_STORE_DIR "/tmp/sha256_chunks"
+#define CHUNK_PATH_LEN 256
+
+// Crea (se serve) la directory dello store e quella dei manifest; ritorna 0 in caso di successo
+int chunk_store_init(const char* dir);
+
+// 1 se lo store contiene già il chunk con questo digest
+int chunk_store_has(const char* dir, const char* digest);
+
+// Salva un chunk (scrittura su file temporaneo + rename, atomica rispetto ai lettori)
+int chunk_store_put(const char* dir, const char* digest, const void* data, size_t len);
+
+// Calcola lo SHA-256 dell'intero file ricomponendolo dai chunk elencati nel manifest
+// (un digest per riga, in ordine). `output_hash` vuoto in caso di errore
+void compute_sha256_from_manifest(const char* dir, const char* manifest_path, char* output_hash);
+
+// Conserva il manifest di un file completo sotto il suo digest (spostandolo, non copiandolo):
+// una verifica successiva contro quel digest può confrontare i chunk uno a uno
+int chunk_store_save_manifest(const char* dir, const char* file_digest, const char* manifest_path);
+
+// Carica in memoria il manifest conservato per `file_digest`: `*count` digest da MANIFEST_DIGEST_LEN
+// byte (64 caratteri + terminatore) uno dopo l'altro, da liberare con free.
+// NULL se non esiste o contiene righe non valide
+#define MANIFEST_DIGEST_LEN 65
+char* chunk_store_load_manifest(const char* dir, const char* file_digest, size_t* count);
+
+#endif
@@ -0,0 +1,171 @@
+#include "trace_utils.h"
+
+#define TRACE_STAGE_NAME(name) #name,
+static const char* stage_names[] = { TRACE_STAGES(TRACE_STAGE_NAME) };
+
+// ---- NOME STADIO ----
+const char* trace_stage_name(uint32_t stage) {
+    return (stage < TRACE_STAGE_COUNT) ? stage_names[stage] : "unknown";
+}
+
+#ifdef SHA256_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define TRACE_MAX_THREADS 64
+
+// Ring buffer di un thread: scritto solo dal proprietario, nessun lock sul percorso caldo
+struct trace_ring {
+    struct trace_event events[TRACE_RING_SIZE];
+    uint64_t head;      // eventi registrati in totale
+};
+
+static struct trace_ring* rings[TRACE_MAX_THREADS];
+static unsigned int ring_count = 0;
+static _Thread_local struct trace_ring* my_ring = NULL;
+static _Thread_local int ring_unavailable = 0;
+static pid_t trace_pid = 0;     // getpid() in cache: aggiornato dopo ogni fork
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+
+// Percorsi del dump per il pid corrente, pronti prima che il signal handler ne abbia bisogno
+static char dump_path[64];
+static char dump_tmp_path[72];
+
+static void set_dump_paths(void) {
+    snprintf(dump_path, sizeof(dump_path), TRACE_FILE_FMT, trace_pid);
+    snprintf(dump_tmp_path, sizeof(dump_tmp_path), "%s.tmp", dump_path);
+}
+
+// ---- SCRITTURA COMPLETA ----
+static int write_all(int fd, const void* buf, size_t len) {
+    const char* p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// ---- DUMP SU FILE ----
+// Solo chiamate async-signal-safe (open, write, rename): il dump parte all'uscita del processo
+// e, su richiesta, da un signal handler. Ogni dump sostituisce il file con il contenuto corrente
+// dei ring, scrivendo su un file temporaneo e rinominandolo. Un evento che il thread interrotto
+// sta registrando non è ancora contato in head, quindi non finisce nel dump a metà
+static void trace_dump(void) {
+    uint64_t total = 0;
+    unsigned int n = __atomic_load_n(&ring_count, __ATOMIC_ACQUIRE);
+    if (n > TRACE_MAX_THREADS) n = TRACE_MAX_THREADS;
+    for (unsigned int i = 0; i < n; ++i) {
+        if (!rings[i]) continue;
+        total += (rings[i]->head < TRACE_RING_SIZE) ? rings[i]->head : TRACE_RING_SIZE;
+    }
+    if (total == 0) return;
+
+    int fd = open(dump_tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) return;
+
+    struct trace_file_header header = { TRACE_MAGIC, (uint32_t)total, trace_pid, 0 };
+    int ok = write_all(fd, &header, sizeof(header)) == 0;
+
+    // Eventi in ordine cronologico per ogni ring (dal più vecchio ancora presente):
+    // al più due tratti contigui del buffer circolare
+    for (unsigned int i = 0; i < n && ok; ++i) {
+        struct trace_ring* r = rings[i];
+        if (!r) continue;
+        uint64_t head = r->head;
+        uint64_t first = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+        size_t start = first % TRACE_RING_SIZE;
+        size_t count = (size_t)(head - first);
+        size_t tail = (start + count > TRACE_RING_SIZE) ? TRACE_RING_SIZE - start : count;
+
+        ok = write_all(fd, &r->events[start], tail * sizeof(struct trace_event)) == 0 &&
+             write_all(fd, &r->events[0], (count - tail) * sizeof(struct trace_event)) == 0;
+    }
+    close(fd);
+
+    if (!ok || rename(dump_tmp_path, dump_path) == -1) unlink(dump_tmp_path);
+}
+
+static void trace_dump_at_exit(void) {
+    trace_dump();
+}
+
+static void trace_dump_signal(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+    trace_dump();
+    errno = saved_errno;
+}
+
+// ---- RESET NEL FIGLIO DOPO FORK ----
+// Il figlio eredita i ring del padre: li svuota per non duplicarne gli eventi nel proprio dump
+static void trace_reset_in_child(void) {
+    trace_pid = getpid();
+    set_dump_paths();
+
+    unsigned int n = __atomic_load_n(&ring_count, __ATOMIC_ACQUIRE);
+    if (n > TRACE_MAX_THREADS) n = TRACE_MAX_THREADS;
+    for (unsigned int i = 0; i < n; ++i) {
+        if (rings[i]) rings[i]->head = 0;
+    }
+}
+
+static void trace_init_process(void) {
+    trace_pid = getpid();
+    set_dump_paths();
+    atexit(trace_dump_at_exit);
+    pthread_atfork(NULL, NULL, trace_reset_in_child);
+}
+
+// ---- DUMP SU RICHIESTA ----
+void trace_dump_on_signal(int sig) {
+    pthread_once(&trace_once, trace_init_process);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = trace_dump_signal;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(sig, &sa, NULL) == -1) perror("sigaction trace dump");
+}
+
+// ---- REGISTRAZIONE EVENTO ----
+void trace_record(uint32_t stage, pid_t req_pid, uint32_t req_seq, uint32_t arg) {
+    if (!my_ring) {
+        if (ring_unavailable) return;
+        pthread_once(&trace_once, trace_init_process);
+
+        unsigned int slot = __atomic_fetch_add(&ring_count, 1, __ATOMIC_ACQ_REL);
+        my_ring = (slot < TRACE_MAX_THREADS) ? calloc(1, sizeof(struct trace_ring)) : NULL;
+        if (!my_ring) {
+            ring_unavailable = 1;   // troppi thread o memoria esaurita: eventi di questo thread scartati
+            return;
+        }
+        __atomic_store_n(&rings[slot], my_ring, __ATOMIC_RELEASE);
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    struct trace_event* ev = &my_ring->events[my_ring->head % TRACE_RING_SIZE];
+    ev->ts_ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+    ev->pid = trace_pid;
+    ev->req_pid = req_pid;
+    ev->req_seq = req_seq;
+    ev->stage = stage;
+    ev->arg = arg;
+    ev->reserved = 0;
+    my_ring->head++;
+}
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef TRACE_UTILS_H
+#define TRACE_UTILS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Stadi della pipeline tracciati (server e client). Le coppie *_wait/*_acquired,
+// *_begin/*_end e pending_enqueue/pending_dequeue delimitano un intervallo
+#define TRACE_STAGES(X)          \
+    X(msg_recv)                  \
+    X(pending_enqueue)           \
+    X(pending_dequeue)           \
+    X(sem_mem_wait)              \
+    X(sem_mem_acquired)          \
+    X(tmp_write_begin)           \
+    X(tmp_write_end)             \
+    X(ack_sent)                  \
+    X(sem_proc_wait)             \
+    X(sem_proc_acquired)         \
+    X(hash_begin)                \
+    X(hash_end)                  \
+    X(resp_sent)                 \
+    X(client_chunk_send)         \
+    X(client_ack_recv)           \
+    X(client_resp_recv)
+
+#define TRACE_STAGE_ENUM(name) TRACE_STAGE_##name,
+enum trace_stage {
+    TRACE_STAGES(TRACE_STAGE_ENUM)
+    TRACE_STAGE_COUNT
+};
+
+// Evento registrato nel ring buffer (e nel file di dump)
+struct trace_event {
+    uint64_t ts_ns;     // CLOCK_MONOTONIC: confrontabile tra processi dello stesso host
+    int32_t pid;        // processo che ha registrato l'evento
+    int32_t req_pid;    // client a cui appartiene la richiesta
+    uint32_t req_seq;   // numero della richiesta nel client: (req_pid, req_seq) identifica la richiesta
+    uint32_t stage;
+    uint32_t arg;       // chunk_id
+    uint32_t reserved;
+};
+
+// Intestazione dei file di dump: /tmp/sha256_trace_<pid>.bin
+#define TRACE_MAGIC 0x52544853u     // "SHTR"
+#define TRACE_FILE_FMT "/tmp/sha256_trace_%d.bin"
+#define TRACE_RING_SIZE 65536       // eventi per thread; i più vecchi vengono sovrascritti
+
+struct trace_file_header {
+    uint32_t magic;
+    uint32_t count;
+    int32_t pid;
+    uint32_t reserved;
+};
+
+// Nome testuale di uno stadio
+const char* trace_stage_name(uint32_t stage);
+
+#ifdef SHA256_TRACE
+
+// Registra un evento nel ring buffer del thread corrente (dump automatico all'uscita del processo)
+void trace_record(uint32_t stage, pid_t req_pid, uint32_t req_seq, uint32_t arg);
+
+// Scrive il dump anche alla ricezione di `sig`, senza terminare il processo: un processo di lunga
+// durata (lo shard) si ispeziona mentre è in esecuzione. Le chiamate di sistema bloccanti interrotte
+// dal segnale ritornano con EINTR
+void trace_dump_on_signal(int sig);
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define TRACE_USDT(stage, req_pid, req_seq, arg) DTRACE_PROBE3(sha256, stage, req_pid, req_seq, arg)
+#else
+#define TRACE_USDT(stage, req_pid, req_seq, arg) ((void)0)
+#endif
+
+#define TRACE(stage, req_pid, req_seq, arg)                                                  \
+    do {                                                                                     \
+        TRACE_USDT(stage, req_pid, req_seq, arg);                                            \
+        trace_record(TRACE_STAGE_##stage, (req_pid), (uint32_t)(req_seq), (uint32_t)(arg));  \
+    } while (0)
+
+#define TRACE_DUMP_ON_SIGNAL(sig) trace_dump_on_signal(sig)
+
+#else
+
+// Tracing disabilitato: nessun codice generato
+#define TRACE(stage, req_pid, req_seq, arg) ((void)0)
+#define TRACE_DUMP_ON_SIGNAL(sig) ((void)0)
+
+#endif
+
+#endif
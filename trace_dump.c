@@ -0,0 +1,250 @@
+// trace_dump.c – Legge i dump di tracing e produce la timeline per richiesta o un export Chrome trace
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "trace/trace_utils.h"
+
+#define TRACE_DIR "/tmp"
+#define TRACE_PREFIX "sha256_trace_"
+
+// Intervalli ricostruiti da coppie di stadi (inizio, fine)
+struct stage_pair {
+    uint32_t begin;
+    uint32_t end;
+    const char *name;
+};
+
+static const struct stage_pair pairs[] = {
+    { TRACE_STAGE_pending_enqueue,   TRACE_STAGE_pending_dequeue,   "pending_queue" },
+    { TRACE_STAGE_sem_mem_wait,      TRACE_STAGE_sem_mem_acquired,  "sem_mem_wait" },
+    { TRACE_STAGE_tmp_write_begin,   TRACE_STAGE_tmp_write_end,     "tmp_write" },
+    { TRACE_STAGE_sem_proc_wait,     TRACE_STAGE_sem_proc_acquired, "sem_proc_wait" },
+    { TRACE_STAGE_hash_begin,        TRACE_STAGE_hash_end,          "hash" },
+    { TRACE_STAGE_client_chunk_send, TRACE_STAGE_client_ack_recv,   "chunk_roundtrip" },
+};
+#define NUM_PAIRS (sizeof(pairs) / sizeof(pairs[0]))
+
+struct trace_event *events = NULL;
+size_t num_events = 0;
+
+// ===================== CARICAMENTO =====================
+
+// Aggiunge gli eventi di un file di dump; ritorna -1 se il file non è valido
+int carica_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    struct trace_file_header header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != TRACE_MAGIC) {
+        fprintf(stderr, "%s: non è un dump di tracing\n", path);
+        fclose(f);
+        return -1;
+    }
+
+    struct trace_event *grown = realloc(events, (num_events + header.count) * sizeof(*events));
+    if (!grown) {
+        perror("realloc");
+        fclose(f);
+        return -1;
+    }
+    events = grown;
+    num_events += fread(events + num_events, sizeof(*events), header.count, f);
+    fclose(f);
+    return 0;
+}
+
+// Carica tutti i dump presenti in TRACE_DIR
+void carica_directory(void) {
+    DIR *dir = opendir(TRACE_DIR);
+    if (!dir) return;
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strncmp(ent->d_name, TRACE_PREFIX, strlen(TRACE_PREFIX)) != 0) continue;
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", TRACE_DIR, ent->d_name);
+        carica_file(path);
+    }
+    closedir(dir);
+}
+
+int confronta_ts(const void *a, const void *b) {
+    const struct trace_event *x = a, *y = b;
+    return (x->ts_ns > y->ts_ns) - (x->ts_ns < y->ts_ns);
+}
+
+// ===================== ACCOPPIAMENTO INTERVALLI =====================
+
+// Indice dell'evento di inizio che chiude l'evento `i` (stesso processo, richiesta e chunk), -1 se nessuno
+long trova_inizio(size_t i, uint32_t begin_stage, const char *used) {
+    for (long j = (long)i - 1; j >= 0; --j) {
+        const struct trace_event *b = &events[j];
+        if (b->stage == begin_stage && !used[j] && b->req_pid == events[i].req_pid &&
+            b->req_seq == events[i].req_seq && b->arg == events[i].arg && b->pid == events[i].pid) {
+            return j;
+        }
+    }
+    return -1;
+}
+
+const struct stage_pair *coppia_di_fine(uint32_t stage) {
+    for (size_t p = 0; p < NUM_PAIRS; ++p) {
+        if (pairs[p].end == stage) return &pairs[p];
+    }
+    return NULL;
+}
+
+int e_inizio(uint32_t stage) {
+    for (size_t p = 0; p < NUM_PAIRS; ++p) {
+        if (pairs[p].begin == stage) return 1;
+    }
+    return 0;
+}
+
+// ===================== TIMELINE PER RICHIESTA =====================
+
+void stampa_timeline(pid_t only_client) {
+    char *used = calloc(num_events, 1);
+    char *done = calloc(num_events, 1);     // richieste già stampate (indice del primo evento)
+    if (!used || !done) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    // Una richiesta è un file inviato da un client: (req_pid, req_seq)
+    for (size_t first = 0; first < num_events; ++first) {
+        pid_t client = events[first].req_pid;
+        uint32_t seq = events[first].req_seq;
+        if (done[first] || (only_client && client != only_client)) continue;
+
+        uint64_t t0 = events[first].ts_ns, t_last = t0;
+        uint64_t totals[NUM_PAIRS] = {0};
+        printf("== richiesta client PID=%d #%u ==\n", client, seq);
+
+        for (size_t i = first; i < num_events; ++i) {
+            const struct trace_event *ev = &events[i];
+            if (ev->req_pid != client || ev->req_seq != seq) continue;
+            done[i] = 1;
+            t_last = ev->ts_ns;
+
+            printf("  +%10.3f ms  %-18s chunk=%-6u pid=%d", (ev->ts_ns - t0) / 1e6,
+                   trace_stage_name(ev->stage), ev->arg, ev->pid);
+
+            const struct stage_pair *pair = coppia_di_fine(ev->stage);
+            long b = pair ? trova_inizio(i, pair->begin, used) : -1;
+            if (b >= 0) {
+                used[b] = 1;
+                uint64_t dur = ev->ts_ns - events[b].ts_ns;
+                totals[pair - pairs] += dur;
+                printf("  [%s %.3f ms]", pair->name, dur / 1e6);
+            }
+            printf("\n");
+        }
+
+        printf("  totale %.3f ms;", (t_last - t0) / 1e6);
+        for (size_t p = 0; p < NUM_PAIRS; ++p) {
+            if (totals[p]) printf(" %s=%.3f ms", pairs[p].name, totals[p] / 1e6);
+        }
+        printf("\n\n");
+    }
+    free(used);
+    free(done);
+}
+
+// ===================== EXPORT CHROME TRACE =====================
+
+// Intervalli come eventi "X" (complete), stadi non accoppiati come eventi istantanei "i"
+int esporta_chrome(const char *path, pid_t only_client) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+
+    char *used = calloc(num_events, 1);
+    if (!used) {
+        perror("calloc");
+        fclose(out);
+        return -1;
+    }
+
+    fprintf(out, "{\"traceEvents\":[\n");
+    int first_written = 1;
+    for (size_t i = 0; i < num_events; ++i) {
+        const struct trace_event *ev = &events[i];
+        if (only_client && ev->req_pid != only_client) continue;
+
+        const struct stage_pair *pair = coppia_di_fine(ev->stage);
+        long b = pair ? trova_inizio(i, pair->begin, used) : -1;
+        if (e_inizio(ev->stage)) continue;  // emesso insieme al proprio evento di fine
+
+        fprintf(out, "%s", first_written ? "" : ",\n");
+        first_written = 0;
+        if (b >= 0) {
+            used[b] = 1;
+            fprintf(out, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+                         "\"args\":{\"client\":%d,\"request\":%u,\"chunk\":%u}}",
+                    pair->name, events[b].ts_ns / 1e3, (ev->ts_ns - events[b].ts_ns) / 1e3,
+                    ev->pid, ev->pid, ev->req_pid, ev->req_seq, ev->arg);
+        } else {
+            fprintf(out, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,"
+                         "\"args\":{\"client\":%d,\"request\":%u,\"chunk\":%u}}",
+                    trace_stage_name(ev->stage), ev->ts_ns / 1e3, ev->pid, ev->pid, ev->req_pid, ev->req_seq,
+                    ev->arg);
+        }
+    }
+    fprintf(out, "\n]}\n");
+
+    free(used);
+    fclose(out);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    // ===================== PARSING ARGOMENTI =====================
+    const char *chrome_path = NULL;
+    pid_t only_client = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:p:")) != -1) {
+        if (opt == 'c') {
+            chrome_path = optarg;
+        } else if (opt == 'p') {
+            only_client = (pid_t)atoi(optarg);
+        } else {
+            fprintf(stderr, "Uso: %s [-c out.json] [-p client_pid] [dump...]\n", argv[0]);
+            fprintf(stderr, "Senza file legge tutti i dump " TRACE_DIR "/" TRACE_PREFIX "*.bin\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // ===================== CARICAMENTO E ORDINAMENTO =====================
+    if (optind == argc) {
+        carica_directory();
+    }
+    for (int i = optind; i < argc; ++i) {
+        carica_file(argv[i]);
+    }
+    if (num_events == 0) {
+        fprintf(stderr, "Nessun evento di tracing trovato (compilare con -DSHA256_TRACE=ON).\n");
+        return EXIT_FAILURE;
+    }
+    qsort(events, num_events, sizeof(*events), confronta_ts);
+
+    // ===================== OUTPUT =====================
+    if (chrome_path) {
+        if (esporta_chrome(chrome_path, only_client) == -1) return EXIT_FAILURE;
+        printf("Chrome trace scritto in %s (%zu eventi)\n", chrome_path, num_events);
+    } else {
+        stampa_timeline(only_client);
+    }
+
+    free(events);
+    return EXIT_SUCCESS;
+}